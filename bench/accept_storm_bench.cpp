@@ -0,0 +1,207 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <fmt/core.h>
+#include "ithread.hpp"
+#include "reliable_tcp_server.hpp"
+
+//a reconnect storm: every connection drops at once and all of them come back. a connection counts as
+//established once the server answered a request on it, so the session is really set up. with reuse_port
+//every worker accepts on its own listening socket instead of all of them being fed by one acceptor.
+//many connections need a raised fd limit, ulimit -n
+
+namespace
+{
+    struct connection_t
+    {
+        explicit connection_t(asio::io_context& io_context)
+            : socket_(io_context)
+        {
+        }
+
+        asio::ip::tcp::socket   socket_;
+        uint8_t                 rsp_[64];
+    };
+
+    //one client thread opens its share of the connections, window of them at a time
+    class connector_t
+    {
+    public:
+        connector_t(asio::io_context& io_context, uint16_t port, uint32_t count, std::shared_ptr<ibase::packet_t> req, std::atomic<uint32_t>& established)
+            : io_context_(io_context)
+            , endpoint_(asio::ip::make_address("127.0.0.1"), port)
+            , count_(count)
+            , req_(std::move(req))
+            , established_(established)
+        {
+        }
+
+        void start(uint32_t window)
+        {
+            for (uint32_t i = 0; (i < window) && (next_ < count_); ++i)
+            {
+                connect_next();
+            }
+        }
+
+        void close_all()
+        {
+            for (auto& connection : connections_)
+            {
+                asio::error_code ec;
+                connection->socket_.close(ec);
+            }
+            connections_.clear();
+            next_ = 0;
+        }
+    private:
+        void connect_next()
+        {
+            ++next_;
+            auto connection = std::make_shared<connection_t>(io_context_);
+            connections_.push_back(connection);
+            connection->socket_.async_connect(endpoint_, [this, connection](std::error_code ec) {
+                if (ec)
+                {
+                    std::cout << fmt::format("connect failed, {}", ec.message()) << std::endl;
+                    return;
+                }
+                asio::async_write(connection->socket_, asio::buffer(req_->data(), req_->length()), [this, connection](std::error_code ec, std::size_t) {
+                    if (ec)
+                    {
+                        return;
+                    }
+                    connection->socket_.async_read_some(asio::buffer(connection->rsp_), [this](std::error_code ec, std::size_t) {
+                        if (ec)
+                        {
+                            return;
+                        }
+                        ++established_;
+                        if (next_ < count_)
+                        {
+                            connect_next();
+                        }
+                    });
+                });
+            });
+        }
+    private:
+        asio::io_context&                               io_context_;
+        asio::ip::tcp::endpoint                         endpoint_;
+        uint32_t                                        count_;
+        uint32_t                                        next_{0};
+        std::shared_ptr<ibase::packet_t>                req_;
+        std::atomic<uint32_t>&                          established_;
+        std::vector<std::shared_ptr<connection_t>>      connections_;
+    };
+
+    struct result_t
+    {
+        double first_seconds{0};
+        double reconnect_seconds{0};
+    };
+}
+
+static bool establish(std::vector<std::unique_ptr<ibase::ithread>>& threads, std::vector<std::unique_ptr<connector_t>>& connectors,
+    std::atomic<uint32_t>& established, uint32_t connections, double& seconds)
+{
+    const uint32_t window = 128;
+    established = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < connectors.size(); ++i)
+    {
+        auto connector = connectors[i].get();
+        asio::post(threads[i]->get_io_context(), [connector]() {
+            connector->start(window);
+        });
+    }
+
+    auto deadline = begin + std::chrono::seconds(60);
+    while (established < connections)
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return true;
+}
+
+static void drop(std::vector<std::unique_ptr<ibase::ithread>>& threads, std::vector<std::unique_ptr<connector_t>>& connectors)
+{
+    for (size_t i = 0; i < connectors.size(); ++i)
+    {
+        auto connector = connectors[i].get();
+        asio::post(threads[i]->get_io_context(), [connector]() {
+            connector->close_all();
+        });
+    }
+    //let the server notice and drop the old sessions
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+}
+
+static bool run(uint32_t worker_count, bool reuse_port, uint32_t connections, uint16_t port, result_t& result)
+{
+    const uint32_t client_threads = 4;
+
+    ibase::ithread accept_thread;
+    ibase::reliable_tcp_server_t::server_opt_t opt;
+    opt.worker_count = worker_count;
+    opt.reuse_port = reuse_port;
+    auto server = std::make_shared<ibase::reliable_tcp_server_t>(accept_thread.get_io_context(), port, opt);
+    if (!server->start())
+    {
+        std::cout << "server start failed" << std::endl;
+        return false;
+    }
+    server->register_req_view_processor(1, [&server](uint32_t session_id, const ibase::packet_view_t& packet) {
+        server->send_rsp_for_req(session_id, packet.cmd(), packet.seq(), nullptr, 0);
+    });
+
+    auto req = ibase::packet_t::build_packet(1, 1, false, nullptr, 0);
+    std::atomic<uint32_t> established{0};
+    std::vector<std::unique_ptr<ibase::ithread>> threads;
+    std::vector<std::unique_ptr<connector_t>> connectors;
+    for (uint32_t t = 0; t < client_threads; ++t)
+    {
+        uint32_t count = connections / client_threads + ((t < connections % client_threads) ? 1 : 0);
+        threads.push_back(std::make_unique<ibase::ithread>());
+        connectors.push_back(std::make_unique<connector_t>(threads.back()->get_io_context(), port, count, req, established));
+    }
+
+    bool ok = establish(threads, connectors, established, connections, result.first_seconds);
+    if (ok)
+    {
+        drop(threads, connectors);
+        ok = establish(threads, connectors, established, connections, result.reconnect_seconds);
+    }
+    drop(threads, connectors);
+
+    server->stop();
+    threads.clear();
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t connections = (argc > 1) ? (uint32_t)atoi(argv[1]) : 2000;
+    uint32_t workers = (argc > 2) ? (uint32_t)atoi(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+    uint16_t port = 8195;
+    for (bool reuse_port : {false, true})
+    {
+        result_t result;
+        if (!run(workers, reuse_port, connections, port++, result))
+        {
+            std::cout << fmt::format("reuse_port {:<5}  not all {} connections came up", reuse_port, connections) << std::endl;
+            continue;
+        }
+        std::cout << fmt::format("reuse_port {:<5}  workers {:>3}  first {:>8.3f} s  re-establish {:>8.3f} s  {:>10.0f} accepts/s",
+            reuse_port, workers, result.first_seconds, result.reconnect_seconds, connections / result.reconnect_seconds) << std::endl;
+    }
+    return 0;
+}
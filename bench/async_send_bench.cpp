@@ -0,0 +1,125 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fmt/core.h>
+#include "ithread.hpp"
+#include "reliable_tcp_client.hpp"
+#include "reliable_tcp_server.hpp"
+
+//application threads pushing responses to sessions of other threads, the way a backend answers requests it
+//took off the server. send_rsp_for_req waits for the session's thread on every call, send_rsp_for_req_async
+//queues and goes on. the time is until every send was taken over by the sessions, the callbacks count them
+
+namespace
+{
+    struct result_t
+    {
+        double sends_per_second{0};
+        double producer_seconds{0};
+    };
+}
+
+static result_t run(bool async, uint32_t producer_count, uint32_t sends_per_producer, uint16_t port)
+{
+    const uint32_t client_count = 8;
+
+    ibase::ithread accept_thread;
+    ibase::reliable_tcp_server_t::server_opt_t opt;
+    opt.worker_count = 2;
+    auto server = std::make_shared<ibase::reliable_tcp_server_t>(accept_thread.get_io_context(), port, opt);
+    server->start();
+
+    //every client says hello with one request, that is how the producers learn the session ids
+    std::mutex sessions_mutex;
+    std::vector<uint32_t> session_ids;
+    server->register_req_view_processor(1, [&server, &sessions_mutex, &session_ids](uint32_t session_id, const ibase::packet_view_t& packet) {
+        {
+            std::lock_guard<std::mutex> lock(sessions_mutex);
+            session_ids.push_back(session_id);
+        }
+        server->send_rsp_for_req(session_id, packet.cmd(), packet.seq(), nullptr, 0);
+    });
+
+    ibase::ithread client_thread;
+    std::vector<std::shared_ptr<ibase::reliable_tcp_client_t>> clients;
+    std::atomic<uint32_t> connected{0};
+    for (uint32_t c = 0; c < client_count; ++c)
+    {
+        auto client = std::make_shared<ibase::reliable_tcp_client_t>(client_thread.get_io_context());
+        client->start("127.0.0.1", port);
+        client->send_req_view_async(1, nullptr, 0, nullptr, [&connected](uint32_t, int, const ibase::packet_view_t&) {
+            ++connected;
+        });
+        clients.push_back(client);
+    }
+    while (connected < client_count)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    uint8_t body[64] = {0};
+    std::atomic<uint64_t> done{0};
+    uint64_t total = (uint64_t)producer_count * sends_per_producer;
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for (uint32_t p = 0; p < producer_count; ++p)
+    {
+        producers.emplace_back([&, p]() {
+            //responses to requests the clients never sent, they drop them
+            for (uint32_t i = 0; i < sends_per_producer; ++i)
+            {
+                auto session_id = session_ids[(p + i) % session_ids.size()];
+                if (async)
+                {
+                    server->send_rsp_for_req_async(session_id, 2, i, body, sizeof(body), [&done](bool) {
+                        ++done;
+                    });
+                }
+                else
+                {
+                    server->send_rsp_for_req(session_id, 2, i, body, sizeof(body));
+                    ++done;
+                }
+            }
+        });
+    }
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+    auto produced = std::chrono::steady_clock::now();
+    while (done < total)
+    {
+        std::this_thread::yield();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    result_t result;
+    result.sends_per_second = total / std::chrono::duration<double>(end - begin).count();
+    result.producer_seconds = std::chrono::duration<double>(produced - begin).count();
+
+    for (auto& client : clients)
+    {
+        client->stop();
+    }
+    server->stop();
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t producers = (argc > 1) ? (uint32_t)atoi(argv[1]) : 4;
+    uint32_t sends = (argc > 2) ? (uint32_t)atoi(argv[2]) : 100000;
+    uint16_t port = 8197;
+    for (bool async : {false, true})
+    {
+        auto result = run(async, producers, sends, port++);
+        std::cout << fmt::format("{:<24} producers {:>3}  {:>10.0f} sends/s  producers done after {:>7.3f} s",
+            async ? "send_rsp_for_req_async" : "send_rsp_for_req", producers, result.sends_per_second, result.producer_seconds) << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include <iostream>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <fmt/core.h>
+#include "ithread.hpp"
+#include "task_runner.hpp"
+#include "reliable_tcp_client.hpp"
+
+//how fast producer threads get requests into one client. the rate is until the client's thread has taken
+//every request over, the wire is not part of it: nothing listens on the port, so the requests stay pending
+
+static void wait_drained(asio::io_context& io_context)
+{
+    //with the producers done the ring holds at most one drain's worth. the first round trip waits for the
+    //drain under way, which may post one more, the second one for that
+    for (int i = 0; i < 2; ++i)
+    {
+        ibase::task::run_task_in_the_iocontext_sync<void>(io_context, []() {});
+    }
+}
+
+static double run(uint32_t producer_count, uint32_t requests_per_producer, uint16_t port)
+{
+    ibase::ithread client_thread;
+    auto client = std::make_shared<ibase::reliable_tcp_client_t>(client_thread.get_io_context());
+    client->start("127.0.0.1", port);
+
+    uint8_t body[64] = {0};
+    //long enough that nothing is resent or expires while it runs
+    ibase::reliable_tcp_client_t::send_opt_t opt{1, 600};
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for (uint32_t p = 0; p < producer_count; ++p)
+    {
+        producers.emplace_back([&]() {
+            for (uint32_t i = 0; i < requests_per_producer; ++i)
+            {
+                client->send_req_view_async(1, body, sizeof(body), &opt, nullptr);
+            }
+        });
+    }
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+    wait_drained(client_thread.get_io_context());
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    client->stop();
+    return producer_count * requests_per_producer / seconds;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t max_producers = (argc > 1) ? (uint32_t)atoi(argv[1]) : 8;
+    uint32_t requests = (argc > 2) ? (uint32_t)atoi(argv[2]) : 200000;
+    for (uint32_t producers = 1; producers <= max_producers; producers *= 2)
+    {
+        auto rate = run(producers, requests, 8198);
+        std::cout << fmt::format("producers {:>3}  {:>10.0f} requests/s", producers, rate) << std::endl;
+    }
+    return 0;
+}
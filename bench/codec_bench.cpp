@@ -0,0 +1,99 @@
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <fmt/core.h>
+#include "codec.hpp"
+#include "packet.hpp"
+
+//bytes saved by body compression against the cpu it costs, for a few typical notification bodies.
+//publish_notification pays the build cost once per notification, not once per session
+
+template<typename F>
+static double us_per_op(uint32_t rounds, F f)
+{
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < rounds; ++i)
+    {
+        f();
+    }
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count() / rounds;
+}
+
+static std::vector<uint8_t> make_text(uint32_t len)
+{
+    std::string text;
+    std::mt19937 rng(7);
+    while (text.size() < len)
+    {
+        text += fmt::format("{{\"symbol\":\"SYM{}\",\"price\":{}.{},\"volume\":{},\"side\":\"{}\"}},", rng() % 50, rng() % 1000, rng() % 100, rng() % 100000, (rng() & 1) ? "buy" : "sell");
+    }
+    return std::vector<uint8_t>(text.begin(), text.begin() + len);
+}
+
+static std::vector<uint8_t> make_structs(uint32_t len)
+{
+    //fixed size records of small integers, like a serialized table
+    std::vector<uint8_t> data(len);
+    std::mt19937 rng(11);
+    for (uint32_t i = 0; i + 16 <= len; i += 16)
+    {
+        uint32_t record[4] = {i / 16, (uint32_t)(rng() % 16), (uint32_t)(1000 + rng() % 8), 0};
+        memcpy(data.data() + i, record, sizeof(record));
+    }
+    return data;
+}
+
+static std::vector<uint8_t> make_random(uint32_t len)
+{
+    std::vector<uint8_t> data(len);
+    std::mt19937 rng(13);
+    for (auto& b : data)
+    {
+        b = uint8_t(rng());
+    }
+    return data;
+}
+
+static void run(const char* name, std::vector<uint8_t> body)
+{
+    const uint32_t rounds = 20000;
+    const uint32_t body_len = (uint32_t)body.size();
+    volatile uint32_t sink = 0;
+
+    ibase::packet_t::build_opt_t plain_opt;
+    ibase::packet_t::build_opt_t lz_opt;
+    lz_opt.codec = ibase::codec::find_codec(ibase::codec::lz_codec_id);
+
+    auto plain = ibase::packet_t::build_packet(1, 1, true, body.data(), body_len, &plain_opt);
+    auto compressed = ibase::packet_t::build_packet(1, 1, true, body.data(), body_len, &lz_opt);
+
+    auto build_plain_cost = us_per_op(rounds, [&]() {
+        sink = sink + ibase::packet_t::build_packet(1, 1, true, body.data(), body_len, &plain_opt)->length();
+    });
+    auto build_lz_cost = us_per_op(rounds, [&]() {
+        sink = sink + ibase::packet_t::build_packet(1, 1, true, body.data(), body_len, &lz_opt)->length();
+    });
+    auto view = ibase::packet_view_t::from_packet(compressed);
+    auto decompress_cost = us_per_op(rounds, [&]() {
+        sink = sink + view.decompress().body_length();
+    });
+
+    auto saved = int64_t(plain->length()) - int64_t(compressed->length());
+    std::cout << fmt::format("{:<8} {:>6} B  wire {:>6} -> {:>6} B  saved {:5.1f}%  build {:7.2f} -> {:7.2f} us  decompress {:7.2f} us  ({:6.0f} MB/s)",
+        name, body_len, plain->length(), compressed->length(), 100.0 * saved / plain->length(),
+        build_plain_cost, build_lz_cost, decompress_cost, compressed->is_compressed() ? body_len / decompress_cost : 0.0) << std::endl;
+}
+
+int main()
+{
+    for (uint32_t len : {256u, 1024u, 4096u, ibase::packet_t::max_body_length})
+    {
+        run("text", make_text(len));
+        run("structs", make_structs(len));
+        run("random", make_random(len));
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include <fmt/core.h>
+#include "crc32c.hpp"
+#include "packet.hpp"
+
+//cost of the optional body checksum, reported as milliseconds per GB of payload
+
+template<typename F>
+static double ms_per_gb(uint64_t bytes_per_round, F f)
+{
+    const uint64_t total_bytes = 4ull * 1024 * 1024 * 1024;
+    auto rounds = total_bytes / bytes_per_round;
+    auto begin = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < rounds; ++i)
+    {
+        f();
+    }
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    return elapsed / (double(rounds * bytes_per_round) / (1024.0 * 1024 * 1024));
+}
+
+int main()
+{
+    const uint32_t body_len = 16 * 1024 - 64;
+    std::vector<uint8_t> src(body_len);
+    std::vector<uint8_t> dst(body_len);
+    for (uint32_t i = 0; i < body_len; ++i)
+    {
+        src[i] = uint8_t(i * 131 + 7);
+    }
+
+    volatile uint32_t sink = 0;
+    std::cout << fmt::format("crc32c hardware accelerated: {}", ibase::crc32c::hardware_accelerated()) << std::endl;
+
+    auto memcpy_cost = ms_per_gb(body_len, [&]() {
+        memcpy(dst.data(), src.data(), body_len);
+        sink = sink + dst[body_len / 2];
+    });
+    auto crc_cost = ms_per_gb(body_len, [&]() {
+        sink = sink + ibase::crc32c::value(src.data(), body_len);
+    });
+    auto fused_cost = ms_per_gb(body_len, [&]() {
+        sink = sink + ibase::crc32c::copy_and_extend(0, dst.data(), src.data(), body_len);
+    });
+
+    ibase::packet_t::build_opt_t plain_opt{false};
+    ibase::packet_t::build_opt_t checksum_opt{true};
+    auto build_plain_cost = ms_per_gb(body_len, [&]() {
+        auto packet = ibase::packet_t::build_packet(1, 1, false, src.data(), body_len, &plain_opt);
+        sink = sink + packet->length();
+    });
+    auto build_checksum_cost = ms_per_gb(body_len, [&]() {
+        auto packet = ibase::packet_t::build_packet(1, 1, false, src.data(), body_len, &checksum_opt);
+        sink = sink + packet->length();
+    });
+
+    auto packet = ibase::packet_t::build_packet(1, 1, false, src.data(), body_len, &checksum_opt);
+    auto parse_checksum_cost = ms_per_gb(body_len, [&]() {
+        uint32_t consume_len = 0;
+        ibase::packet_view_t view;
+        ibase::packet_t::parse_packet_view(packet->data(), packet->length(), consume_len, view);
+        sink = sink + view.body_length();
+    });
+
+    std::cout << fmt::format("memcpy                    {:8.2f} ms/GB", memcpy_cost) << std::endl;
+    std::cout << fmt::format("crc32c                    {:8.2f} ms/GB", crc_cost) << std::endl;
+    std::cout << fmt::format("crc32c + copy, one pass   {:8.2f} ms/GB", fused_cost) << std::endl;
+    std::cout << fmt::format("build_packet              {:8.2f} ms/GB", build_plain_cost) << std::endl;
+    std::cout << fmt::format("build_packet + checksum   {:8.2f} ms/GB", build_checksum_cost) << std::endl;
+    std::cout << fmt::format("parse_packet_view + check {:8.2f} ms/GB", parse_checksum_cost) << std::endl;
+    return 0;
+}
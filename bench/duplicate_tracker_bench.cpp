@@ -0,0 +1,132 @@
+#include <iostream>
+#include <chrono>
+#include <set>
+#include <vector>
+#include <fmt/core.h>
+#include "recently_packet_tracker.hpp"
+
+//recently_packet_tracker_t against the std::set tracker it replaced, fed what one busy session sees: a few cmds
+//with the seqs of a shared counter and every 100th packet a retransmit of one sent a little earlier. the new
+//tracker gets the clock once per batch of packets, the way the session reads it once per socket read
+
+using bench_clock_t = std::chrono::steady_clock;
+
+namespace
+{
+    //the former implementation, a tree node per packet and a clock read per packet
+    class set_tracker_t
+    {
+        static constexpr uint32_t max_packet_life_time_in_seconds = 60;
+    public:
+        bool on_receive_packet(const uint32_t cmd, const uint32_t seq)
+        {
+            uint64_t id = ((uint64_t)cmd << 32) | seq;
+            auto cur_tick = std::chrono::duration_cast<std::chrono::seconds>(bench_clock_t::now().time_since_epoch()).count();
+
+            auto offset = cur_tick - first_tick_;
+            if (offset > max_packet_life_time_in_seconds - 1)
+            {
+                auto span = offset + 1 - max_packet_life_time_in_seconds;
+                for (uint64_t i = 0; i < max_packet_life_time_in_seconds && i < span; ++i)
+                {
+                    auto& packet_id_array = packet_time_index_array_[(first_tick_ + i) % max_packet_life_time_in_seconds];
+                    for (auto& old_id : packet_id_array)
+                    {
+                        recently_packet_ids_.erase(old_id);
+                    }
+                    packet_id_array.clear();
+                }
+
+                first_index_ = (first_index_ + span) % max_packet_life_time_in_seconds;
+                offset = max_packet_life_time_in_seconds - 1;
+                first_tick_ = cur_tick - offset;
+            }
+
+            if (recently_packet_ids_.find(id) != recently_packet_ids_.end())
+            {
+                return true;
+            }
+
+            packet_time_index_array_[(first_index_ + offset) % max_packet_life_time_in_seconds].push_back(id);
+            recently_packet_ids_.insert(id);
+            return false;
+        }
+    private:
+        std::set<uint64_t>      recently_packet_ids_;
+        std::vector<uint64_t>   packet_time_index_array_[max_packet_life_time_in_seconds];
+        uint64_t                first_tick_{0};
+        uint32_t                first_index_{0};
+    };
+
+    struct packet_id_t
+    {
+        uint32_t cmd;
+        uint32_t seq;
+    };
+
+    std::vector<packet_id_t> make_traffic(uint32_t count)
+    {
+        std::vector<packet_id_t> traffic;
+        traffic.reserve(count);
+        uint32_t seq = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            //4990 back is never a retransmit itself
+            if ((i % 100 == 99) && (traffic.size() > 4990))
+            {
+                traffic.push_back(traffic[traffic.size() - 4990]);
+                continue;
+            }
+            traffic.push_back({1 + i % 7, ++seq});
+        }
+        return traffic;
+    }
+
+    struct result_t
+    {
+        double packets_per_second{0};
+        uint32_t duplicates{0};
+    };
+
+    template<typename tracker_t, typename batch_t>
+    result_t run(tracker_t& tracker, const std::vector<packet_id_t>& traffic, batch_t on_batch)
+    {
+        const uint32_t batch = 64;
+        result_t result;
+        auto begin = bench_clock_t::now();
+        for (size_t i = 0; i < traffic.size(); ++i)
+        {
+            if (i % batch == 0)
+            {
+                on_batch(tracker);
+            }
+            if (tracker.on_receive_packet(traffic[i].cmd, traffic[i].seq))
+            {
+                ++result.duplicates;
+            }
+        }
+        result.packets_per_second = traffic.size() / std::chrono::duration<double>(bench_clock_t::now() - begin).count();
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t count = (argc > 1) ? (uint32_t)atoi(argv[1]) : 5000000;
+    auto traffic = make_traffic(count);
+
+    auto old_result = [&traffic]() {
+        set_tracker_t tracker;
+        return run(tracker, traffic, [](set_tracker_t&) {});
+    }();
+    auto new_result = [&traffic]() {
+        ibase::recently_packet_tracker_t tracker;
+        return run(tracker, traffic, [](ibase::recently_packet_tracker_t& tracker) {
+            tracker.advance(bench_clock_t::now());
+        });
+    }();
+
+    std::cout << fmt::format("{:<28} {:>12.0f} packets/s  {:>8} duplicates", "std::set tracker", old_result.packets_per_second, old_result.duplicates) << std::endl;
+    std::cout << fmt::format("{:<28} {:>12.0f} packets/s  {:>8} duplicates", "recently_packet_tracker_t", new_result.packets_per_second, new_result.duplicates) << std::endl;
+    return 0;
+}
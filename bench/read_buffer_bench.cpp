@@ -0,0 +1,75 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <fmt/core.h>
+#include "ithread.hpp"
+#include "reliable_tcp_client.hpp"
+#include "reliable_tcp_server.hpp"
+#include "read_buffer_pool.hpp"
+
+//read buffer memory of many mostly idle connections. before the pool every session and every client kept
+//a dedicated 128 KB buffer for its whole life, now they only borrow one while bytes are buffered
+
+static void report(const char* phase, uint32_t connections)
+{
+    auto stats = ibase::read_buffer_pool_t::stats();
+    uint64_t dedicated = 2ull * connections * 128 * 1024;
+    std::cout << fmt::format("{:<10} buffers in use {:>6}  in use {:>9.1f} KB  pooled {:>9.1f} KB  dedicated would be {:>9.1f} KB  acquired {} reused {}",
+        phase, stats.buffers_in_use, stats.bytes_in_use / 1024.0, stats.bytes_pooled / 1024.0, dedicated / 1024.0,
+        stats.acquire_count, stats.reuse_count) << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    const uint32_t connections = (argc > 1) ? (uint32_t)atoi(argv[1]) : 400;
+    const uint16_t port = 8193;
+
+    ibase::ithread server_thread;
+    ibase::ithread client_thread;
+    auto server = std::make_shared<ibase::reliable_tcp_server_t>(server_thread.get_io_context(), port);
+    if (!server->start())
+    {
+        std::cout << "server start failed" << std::endl;
+        return -1;
+    }
+
+    std::vector<uint8_t> body(4096, 'x');
+    server->register_req_view_processor(1, [&server, &body](uint32_t session_id, const ibase::packet_view_t& packet) {
+        server->send_rsp_for_req(session_id, packet.cmd(), packet.seq(), body.data(), (uint32_t)body.size());
+    });
+
+    std::vector<std::shared_ptr<ibase::reliable_tcp_client_t>> clients;
+    for (uint32_t i = 0; i < connections; ++i)
+    {
+        auto client = std::make_shared<ibase::reliable_tcp_client_t>(client_thread.get_io_context());
+        client->start("127.0.0.1", port);
+        clients.push_back(client);
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    report("idle", connections);
+
+    std::atomic<uint32_t> responses{0};
+    for (auto& client : clients)
+    {
+        client->send_req_view_async(1, body.data(), (uint32_t)body.size(), nullptr, [&responses](uint32_t, int, const ibase::packet_view_t&) {
+            ++responses;
+        });
+    }
+    while (responses < connections)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    report("burst", connections);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    report("idle again", connections);
+
+    for (auto& client : clients)
+    {
+        client->stop();
+    }
+    server->stop();
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <fmt/core.h>
+#include "ithread.hpp"
+#include "reliable_tcp_client.hpp"
+#include "reliable_tcp_server.hpp"
+
+//loopback request/response throughput of the server against its number of worker threads. clients keep a
+//fixed number of requests in flight, so the server side is what limits the rate
+
+static double run(uint32_t worker_count, uint16_t port)
+{
+    const uint32_t client_threads = 4;
+    const uint32_t clients_per_thread = 16;
+    const uint32_t window = 16;
+    const auto duration = std::chrono::seconds(2);
+
+    ibase::ithread accept_thread;
+    ibase::reliable_tcp_server_t::server_opt_t opt;
+    opt.worker_count = worker_count;
+    auto server = std::make_shared<ibase::reliable_tcp_server_t>(accept_thread.get_io_context(), port, opt);
+    server->start();
+
+    std::vector<uint8_t> body(256, 'x');
+    server->register_req_view_processor(1, [&server](uint32_t session_id, const ibase::packet_view_t& packet) {
+        server->send_rsp_for_req(session_id, packet.cmd(), packet.seq(), (uint8_t*)packet.body(), packet.body_length());
+    });
+
+    std::vector<std::unique_ptr<ibase::ithread>> threads;
+    std::vector<std::shared_ptr<ibase::reliable_tcp_client_t>> clients;
+    for (uint32_t t = 0; t < client_threads; ++t)
+    {
+        threads.push_back(std::make_unique<ibase::ithread>());
+        for (uint32_t c = 0; c < clients_per_thread; ++c)
+        {
+            auto client = std::make_shared<ibase::reliable_tcp_client_t>(threads.back()->get_io_context());
+            client->start("127.0.0.1", port);
+            clients.push_back(client);
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    std::atomic<bool> running{true};
+    std::atomic<uint64_t> responses{0};
+    std::vector<std::shared_ptr<std::function<void()>>> senders;
+    for (auto& client : clients)
+    {
+        //every response sends the next request from the client's own thread
+        auto send = std::make_shared<std::function<void()>>();
+        senders.push_back(send);
+        std::weak_ptr<ibase::reliable_tcp_client_t> weak_client(client);
+        std::weak_ptr<std::function<void()>> weak_send(send);
+        *send = [weak_client, weak_send, &body, &running, &responses]() {
+            auto client = weak_client.lock();
+            if (!client || !running)
+            {
+                return;
+            }
+            client->send_req_view_async(1, body.data(), (uint32_t)body.size(), nullptr, [weak_send, &responses](uint32_t, int, const ibase::packet_view_t&) {
+                ++responses;
+                if (auto next = weak_send.lock())
+                {
+                    (*next)();
+                }
+            });
+        };
+        for (uint32_t i = 0; i < window; ++i)
+        {
+            (*send)();
+        }
+    }
+
+    auto begin_count = responses.load();
+    auto begin = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(duration);
+    auto count = responses.load() - begin_count;
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    running = false;
+
+    for (auto& client : clients)
+    {
+        client->stop();
+    }
+    server->stop();
+    threads.clear();
+    return count / elapsed;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t max_workers = (argc > 1) ? (uint32_t)atoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+    uint16_t port = 8194;
+    double single = 0;
+    for (uint32_t workers = 1; workers <= max_workers; workers *= 2)
+    {
+        auto rate = run(workers, port++);
+        if (workers == 1)
+        {
+            single = rate;
+        }
+        std::cout << fmt::format("workers {:>3}  {:>10.0f} rsp/s  x{:.2f}", workers, rate, rate / single) << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fmt/core.h>
+#include "ithread.hpp"
+#include "reliable_tcp_client.hpp"
+#include "reliable_tcp_server.hpp"
+
+//latency of cheap requests while other sessions keep a slow processor busy, all sessions on one worker
+//thread. with the processors on the session's thread every cheap request waits for the slow ones queued
+//before it, with handler threads only the sessions that send slow requests wait for them
+
+namespace
+{
+    struct latency_t
+    {
+        double p50_ms{0};
+        double p99_ms{0};
+        double max_ms{0};
+        size_t count{0};
+    };
+
+    latency_t summarize(std::vector<double> samples)
+    {
+        latency_t latency;
+        if (samples.empty())
+        {
+            return latency;
+        }
+
+        std::sort(samples.begin(), samples.end());
+        latency.p50_ms = samples[samples.size() / 2];
+        latency.p99_ms = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+        latency.max_ms = samples.back();
+        latency.count = samples.size();
+        return latency;
+    }
+}
+
+static latency_t run(uint32_t handler_thread_count, uint16_t port)
+{
+    const uint32_t slow_clients = 4;
+    const uint32_t fast_clients = 4;
+    const auto slow_work = std::chrono::milliseconds(5);
+    const auto duration = std::chrono::seconds(3);
+    const uint32_t slow_cmd = 1;
+    const uint32_t fast_cmd = 2;
+
+    ibase::ithread accept_thread;
+    ibase::reliable_tcp_server_t::server_opt_t opt;
+    opt.worker_count = 1;
+    opt.handler_thread_count = handler_thread_count;
+    auto server = std::make_shared<ibase::reliable_tcp_server_t>(accept_thread.get_io_context(), port, opt);
+    server->start();
+    server->register_req_view_processor(slow_cmd, [&server, slow_work](uint32_t session_id, const ibase::packet_view_t& packet) {
+        std::this_thread::sleep_for(slow_work);
+        server->send_rsp_for_req(session_id, packet.cmd(), packet.seq(), nullptr, 0);
+    });
+    server->register_req_view_processor(fast_cmd, [&server](uint32_t session_id, const ibase::packet_view_t& packet) {
+        server->send_rsp_for_req(session_id, packet.cmd(), packet.seq(), nullptr, 0);
+    });
+
+    ibase::ithread client_thread;
+    std::vector<std::shared_ptr<ibase::reliable_tcp_client_t>> clients;
+    for (uint32_t c = 0; c < slow_clients + fast_clients; ++c)
+    {
+        auto client = std::make_shared<ibase::reliable_tcp_client_t>(client_thread.get_io_context());
+        client->start("127.0.0.1", port);
+        clients.push_back(client);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    std::atomic<bool> running{true};
+    std::mutex samples_mutex;
+    std::vector<double> samples;
+    std::vector<std::shared_ptr<std::function<void()>>> senders;
+    for (uint32_t c = 0; c < clients.size(); ++c)
+    {
+        //slow clients keep two requests in flight, fast ones send the next request when the last one returned
+        bool slow = (c < slow_clients);
+        auto send = std::make_shared<std::function<void()>>();
+        senders.push_back(send);
+        std::weak_ptr<ibase::reliable_tcp_client_t> weak_client(clients[c]);
+        std::weak_ptr<std::function<void()>> weak_send(send);
+        *send = [weak_client, weak_send, slow, &running, &samples_mutex, &samples]() {
+            auto client = weak_client.lock();
+            if (!client || !running)
+            {
+                return;
+            }
+            auto begin = std::chrono::steady_clock::now();
+            client->send_req_view_async(slow ? slow_cmd : fast_cmd, nullptr, 0, nullptr, [weak_send, slow, begin, &samples_mutex, &samples](uint32_t, int result, const ibase::packet_view_t&) {
+                if (!slow && (result == 0))
+                {
+                    std::lock_guard<std::mutex> lock(samples_mutex);
+                    samples.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+                }
+                if (auto next = weak_send.lock())
+                {
+                    (*next)();
+                }
+            });
+        };
+        for (uint32_t i = 0; i < (slow ? 2u : 1u); ++i)
+        {
+            (*send)();
+        }
+    }
+
+    std::this_thread::sleep_for(duration);
+    running = false;
+
+    for (auto& client : clients)
+    {
+        client->stop();
+    }
+    server->stop();
+
+    std::lock_guard<std::mutex> lock(samples_mutex);
+    return summarize(samples);
+}
+
+int main(int argc, char** argv)
+{
+    //with no more threads than slow sessions the cheap requests wait for a thread to come free
+    uint32_t handler_threads = (argc > 1) ? (uint32_t)atoi(argv[1]) : 8;
+    uint16_t port = 8196;
+    for (uint32_t count : {0u, handler_threads})
+    {
+        auto latency = run(count, port++);
+        std::cout << fmt::format("handler threads {:>3}  cheap requests {:>8}  p50 {:>8.3f} ms  p99 {:>8.3f} ms  max {:>8.3f} ms",
+            count, latency.count, latency.p50_ms, latency.p99_ms, latency.max_ms) << std::endl;
+    }
+    return 0;
+}
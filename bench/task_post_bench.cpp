@@ -0,0 +1,162 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <memory>
+#include <new>
+#include <thread>
+#include <fmt/core.h>
+#include "ithread.hpp"
+#include "task_runner.hpp"
+
+//heap allocations and rate of posting tasks to an io_context, the std::function wrapped into a copying lambda
+//the way task_runner.hpp used to against small_task_t. the capture is about what the library posts: a weak
+//pointer, a shared pointer and two ids, more than std::function keeps without allocating. on the io_context
+//thread every task posts the next one, asio recycles its own handler memory there, so what is left is the
+//task's. from another thread asio allocates each handler anyway
+
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+    struct result_t
+    {
+        double tasks_per_second{0};
+        double allocations_per_task{0};
+    };
+
+    void post_function(asio::io_context& io_context, std::function<void()> task)
+    {
+        io_context.post([task]() {
+            task();
+        });
+    }
+
+    void post_small_task(asio::io_context& io_context, ibase::small_task_t<> task)
+    {
+        ibase::task::run_task_in_the_iocontext_async(io_context, std::move(task));
+    }
+
+    template<typename post_t>
+    struct chain_t
+    {
+        asio::io_context& io_context_;
+        post_t post_;
+        std::weak_ptr<int> weak_owner_;
+        std::shared_ptr<int> owner_;
+        uint32_t left_;
+        std::promise<void> done_;
+
+        void next(uint32_t id)
+        {
+            if (left_-- == 0)
+            {
+                done_.set_value();
+                return;
+            }
+
+            post_(io_context_, [this, weak_owner = weak_owner_, owner = owner_, id]() {
+                if (weak_owner.lock() && owner)
+                {
+                    next(id + 1);
+                }
+            });
+        }
+    };
+}
+
+template<typename post_t>
+static result_t run_chain(post_t post, uint32_t count)
+{
+    ibase::ithread thread;
+    auto& io_context = thread.get_io_context();
+    auto owner = std::make_shared<int>(0);
+    chain_t<post_t> chain{io_context, post, owner, owner, count, {}};
+    auto done = chain.done_.get_future();
+    //a few rounds first, asio keeps the handler memory it recycles per thread
+    ibase::task::run_task_in_the_iocontext_sync<void>(io_context, []() {});
+
+    auto before = allocations.load();
+    auto begin = std::chrono::steady_clock::now();
+    ibase::task::run_task_in_the_iocontext_async(io_context, [&chain]() {
+        chain.next(0);
+    });
+    done.wait();
+    auto end = std::chrono::steady_clock::now();
+    auto after = allocations.load();
+
+    result_t result;
+    result.tasks_per_second = count / std::chrono::duration<double>(end - begin).count();
+    result.allocations_per_task = (double)(after - before) / count;
+    return result;
+}
+
+template<typename post_t>
+static result_t run_cross(post_t post, uint32_t count)
+{
+    ibase::ithread thread;
+    auto& io_context = thread.get_io_context();
+    auto owner = std::make_shared<int>(0);
+    std::weak_ptr<int> weak_owner(owner);
+    std::atomic<uint32_t> ran{0};
+
+    auto before = allocations.load();
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        post(io_context, [&ran, weak_owner, owner, i]() {
+            if (weak_owner.lock() && owner && (i != UINT32_MAX))
+            {
+                ran.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    while (ran < count)
+    {
+        std::this_thread::yield();
+    }
+    auto end = std::chrono::steady_clock::now();
+    auto after = allocations.load();
+
+    result_t result;
+    result.tasks_per_second = count / std::chrono::duration<double>(end - begin).count();
+    result.allocations_per_task = (double)(after - before) / count;
+    return result;
+}
+
+static void print(const char* name, const result_t& result)
+{
+    std::cout << fmt::format("{:<40} {:>10.0f} tasks/s  {:>5.2f} allocations/task", name, result.tasks_per_second, result.allocations_per_task) << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t count = (argc > 1) ? (uint32_t)atoi(argv[1]) : 1000000;
+    print("std::function, on the io thread", run_chain(post_function, count));
+    print("small_task_t, on the io thread", run_chain(post_small_task, count));
+    print("std::function, from another thread", run_cross(post_function, count));
+    print("small_task_t, from another thread", run_cross(post_small_task, count));
+    return 0;
+}
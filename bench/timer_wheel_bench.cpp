@@ -0,0 +1,154 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <fmt/core.h>
+#include "ithread.hpp"
+#include "task_runner.hpp"
+#include "timer_wheel.hpp"
+
+//insert, cancel and fire rates of the timing wheel against one asio::steady_timer per timer, which is what
+//itimer used before. everything runs on the io_context thread, the way itimer drives the wheel. for the fire
+//rate all timers are due within one 10 ms window, it is how fast the due ones are worked off
+
+using bench_clock_t = std::chrono::steady_clock;
+
+struct rates_t
+{
+    double insert{0};
+    double cancel{0};
+    double fire{0};
+};
+
+static double per_second(uint32_t count, bench_clock_t::time_point begin, bench_clock_t::time_point end)
+{
+    return count / std::chrono::duration<double>(end - begin).count();
+}
+
+//only the io_context thread counts, the count is stored after the time points so the waiting thread sees them
+static void on_fired(std::atomic<uint32_t>& fired, bench_clock_t::time_point& first, bench_clock_t::time_point& last, uint32_t count)
+{
+    auto n = fired.load() + 1;
+    if (n == 1)
+    {
+        first = bench_clock_t::now();
+    }
+    if (n == count)
+    {
+        last = bench_clock_t::now();
+    }
+    fired = n;
+}
+
+static void wait_fired(std::atomic<uint32_t>& fired, uint32_t count)
+{
+    while (fired < count)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+static rates_t run_wheel(uint32_t count)
+{
+    ibase::ithread thread;
+    auto& io_context = thread.get_io_context();
+    rates_t rates;
+
+    ibase::task::run_task_in_the_iocontext_sync<void>(io_context, [&io_context, &rates, count]() {
+        auto& wheel = ibase::timer_wheel_t::of(io_context);
+        std::vector<uint32_t> ids(count);
+        auto begin = bench_clock_t::now();
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            ids[i] = wheel.next_timer_id();
+            wheel.schedule(ids[i], []() {}, std::chrono::milliseconds(1000 + i % 60000), std::chrono::milliseconds(0));
+        }
+        auto inserted = bench_clock_t::now();
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            wheel.cancel(ids[i]);
+        }
+        auto cancelled = bench_clock_t::now();
+        rates.insert = per_second(count, begin, inserted);
+        rates.cancel = per_second(count, inserted, cancelled);
+    });
+
+    std::atomic<uint32_t> fired{0};
+    bench_clock_t::time_point first;
+    bench_clock_t::time_point last;
+    ibase::task::run_task_in_the_iocontext_sync<void>(io_context, [&io_context, &fired, &first, &last, count]() {
+        auto& wheel = ibase::timer_wheel_t::of(io_context);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            wheel.schedule(wheel.next_timer_id(), [&fired, &first, &last, count]() {
+                on_fired(fired, first, last, count);
+            }, std::chrono::milliseconds(100 + i % 10), std::chrono::milliseconds(0));
+        }
+    });
+    wait_fired(fired, count);
+    rates.fire = per_second(count, first, last);
+    return rates;
+}
+
+static rates_t run_steady_timers(uint32_t count)
+{
+    ibase::ithread thread;
+    auto& io_context = thread.get_io_context();
+    rates_t rates;
+
+    ibase::task::run_task_in_the_iocontext_sync<void>(io_context, [&io_context, &rates, count]() {
+        std::vector<std::unique_ptr<asio::steady_timer>> timers(count);
+        auto begin = bench_clock_t::now();
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            timers[i] = std::make_unique<asio::steady_timer>(io_context);
+            timers[i]->expires_after(std::chrono::milliseconds(1000 + i % 60000));
+            timers[i]->async_wait([](const asio::error_code&) {});
+        }
+        auto inserted = bench_clock_t::now();
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            timers[i].reset();
+        }
+        auto cancelled = bench_clock_t::now();
+        rates.insert = per_second(count, begin, inserted);
+        rates.cancel = per_second(count, inserted, cancelled);
+    });
+
+    std::atomic<uint32_t> fired{0};
+    bench_clock_t::time_point first;
+    bench_clock_t::time_point last;
+    auto timers = std::make_shared<std::vector<std::unique_ptr<asio::steady_timer>>>(count);
+    ibase::task::run_task_in_the_iocontext_sync<void>(io_context, [&io_context, &fired, &first, &last, count, timers]() {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            (*timers)[i] = std::make_unique<asio::steady_timer>(io_context);
+            (*timers)[i]->expires_after(std::chrono::milliseconds(100 + i % 10));
+            (*timers)[i]->async_wait([&fired, &first, &last, count](const asio::error_code&) {
+                on_fired(fired, first, last, count);
+            });
+        }
+    });
+    wait_fired(fired, count);
+    rates.fire = per_second(count, first, last);
+    ibase::task::run_task_in_the_iocontext_sync<void>(io_context, [timers]() {
+        timers->clear();
+    });
+    return rates;
+}
+
+static void report(const char* name, uint32_t count, const rates_t& rates)
+{
+    std::cout << fmt::format("{:<14} {:>8} timers  insert {:>12.0f}/s  cancel {:>12.0f}/s  fire {:>12.0f}/s",
+        name, count, rates.insert, rates.cancel, rates.fire) << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t count = (argc > 1) ? (uint32_t)atoi(argv[1]) : 1000000;
+    report("timer_wheel_t", count, run_wheel(count));
+    report("steady_timer", count, run_steady_timers(count));
+    return 0;
+}
@@ -6,6 +6,7 @@
 #include "task_runner.hpp"
 #include "reliable_tcp_client.hpp"
 #include "reliable_tcp_server.hpp"
+#include "packet_pool.hpp"
 #include "ilogger.hpp"
 #include <fmt/core.h>
 #include <spdlog/spdlog.h>
@@ -35,12 +36,12 @@ int main(int argc, char** argv)
         ibase::logger::write_log(ibase::logger::log_level_info, "server start failed");
         return -1;
     }
-    server_->register_req_processor(1, [&server_](uint32_t session_id, std::shared_ptr<ibase::packet_t> packet) {
-        std::string msg((char*)packet->body(), packet->body_length());
-        ibase::logger::write_log(ibase::logger::log_level_info, fmt::format("server_callback----recv req from client, cmd = {}, seq = {}, msg = {}", packet->cmd(), packet->seq(), msg));
+    server_->register_req_view_processor(1, [&server_](uint32_t session_id, const ibase::packet_view_t& packet) {
+        std::string msg((char*)packet.body(), packet.body_length());
+        ibase::logger::write_log(ibase::logger::log_level_info, fmt::format("server_callback----recv req from client, cmd = {}, seq = {}, msg = {}", packet.cmd(), packet.seq(), msg));
         
-        ibase::logger::write_log(ibase::logger::log_level_info, fmt::format("server_callback----send rsp to client, cmd = {}, seq = {}, msg = {}", packet->cmd(), packet->seq(), rsp_buf));
-        server_->send_rsp_for_req(session_id, packet->cmd(), packet->seq(), (uint8_t*)rsp_buf, rsp_len);
+        ibase::logger::write_log(ibase::logger::log_level_info, fmt::format("server_callback----send rsp to client, cmd = {}, seq = {}, msg = {}", packet.cmd(), packet.seq(), rsp_buf));
+        server_->send_rsp_for_req(session_id, packet.cmd(), packet.seq(), (uint8_t*)rsp_buf, rsp_len);
     });
     
 
@@ -92,6 +93,9 @@ int main(int argc, char** argv)
     auto server_test_timer_id = test_timer_->start_timer([&server_]() {
         ibase::logger::write_log(ibase::logger::log_level_info, fmt::format("server_publish----push notification to client, cmd = {}, msg = {}", 2, push_buf));
         server_->publish_notification(2, (uint8_t*)push_buf, push_len);
+
+        auto pool_stats = ibase::packet_pool_t::stats();
+        ibase::logger::write_log(ibase::logger::log_level_info, fmt::format("packet pool----alloc = {}, reuse = {}, heap alloc = {}, bytes in use = {}", pool_stats.alloc_count, pool_stats.reuse_count, pool_stats.heap_alloc_count, pool_stats.bytes_in_use));
     }, 1, 1);
     
     
@@ -0,0 +1,65 @@
+#include "codec.hpp"
+#include "lz_codec.hpp"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace ibase
+{
+    namespace codec
+    {
+        namespace
+        {
+            struct registry_t
+            {
+                std::mutex                                  mutex_;
+                //replaced codecs stay here too, a receiver may still be decoding with them
+                std::vector<std::shared_ptr<codec_t>>       codecs_;
+                std::atomic<const codec_t*>                 by_id_[256];
+
+                registry_t()
+                {
+                    for (auto& codec : by_id_)
+                    {
+                        codec.store(nullptr, std::memory_order_relaxed);
+                    }
+                    add(lz_codec());
+                }
+
+                void add(std::shared_ptr<codec_t> codec)
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    by_id_[codec->id()].store(codec.get(), std::memory_order_release);
+                    codecs_.push_back(std::move(codec));
+                }
+            };
+
+            registry_t& registry()
+            {
+                static registry_t registry;
+                return registry;
+            }
+        }
+
+        void register_codec(std::shared_ptr<codec_t> codec)
+        {
+            if (!codec)
+            {
+                return;
+            }
+
+            registry().add(std::move(codec));
+        }
+
+        const codec_t* find_codec(uint8_t id)
+        {
+            return registry().by_id_[id].load(std::memory_order_acquire);
+        }
+
+        std::shared_ptr<codec_t> lz_codec()
+        {
+            static std::shared_ptr<codec_t> codec = std::make_shared<lz_codec_t>();
+            return codec;
+        }
+    }
+}
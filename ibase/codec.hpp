@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+#include <memory>
+
+namespace ibase
+{
+    //payload compression codec. the id travels in every compressed body, so both ends must register
+    //the same codec under the same id
+    class codec_t
+    {
+    public:
+        virtual ~codec_t() = default;
+
+        virtual uint8_t id() const = 0;
+        //upper bound of compress() output for raw_len input bytes
+        virtual uint32_t max_compressed_length(uint32_t raw_len) const = 0;
+        //returns the compressed length, 0 if the output would not fit into dst_capacity
+        virtual uint32_t compress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_capacity) const = 0;
+        //true only if the input decodes to exactly dst_len bytes
+        virtual bool decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len) const = 0;
+    };
+
+    namespace codec
+    {
+        constexpr uint8_t no_codec_id = 0;
+        constexpr uint8_t lz_codec_id = 1;
+
+        //codecs live for the rest of the process, registering an id again replaces the previous codec
+        void register_codec(std::shared_ptr<codec_t> codec);
+        const codec_t* find_codec(uint8_t id);
+
+        //the in-tree lz77 codec, registered by default
+        std::shared_ptr<codec_t> lz_codec();
+    }
+}
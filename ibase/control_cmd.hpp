@@ -0,0 +1,85 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+namespace ibase
+{
+    //cmds at the top of the range are used by the library itself between client and session, they never
+    //reach req processors or notification callbacks
+    namespace control_cmd
+    {
+        constexpr uint32_t first_reserved_cmd = 0xffffff00;
+
+        //client -> server request on connect, the response carries the server's capabilities. both bodies
+        //are a uint32 of capability bits in network order. an old server ignores it and nothing changes
+        constexpr uint32_t hello_cmd = first_reserved_cmd;
+        //client -> server requests without a response, the body is a list of uint32 notification cmds in network
+        //order. only count once the client announced capability_subscriptions in its hello, right after which it
+        //subscribes to all it has so far
+        constexpr uint32_t subscribe_cmd = first_reserved_cmd + 1;
+        constexpr uint32_t unsubscribe_cmd = first_reserved_cmd + 2;
+        constexpr uint32_t max_cmds_per_packet = 1024;
+
+        //capability bits
+        constexpr uint32_t capability_compact_header = 0x01;
+        //from the client: push only the cmds it subscribes to. from the server: it does so
+        constexpr uint32_t capability_subscriptions = 0x02;
+        constexpr uint32_t capabilities_length = sizeof(uint32_t);
+
+        inline bool is_control_cmd(uint32_t cmd)
+        {
+            return cmd >= first_reserved_cmd;
+        }
+
+        inline void encode_u32(uint32_t v, uint8_t* buf)
+        {
+            buf[0] = (uint8_t)(v >> 24);
+            buf[1] = (uint8_t)(v >> 16);
+            buf[2] = (uint8_t)(v >> 8);
+            buf[3] = (uint8_t)v;
+        }
+
+        inline uint32_t decode_u32(const uint8_t* buf)
+        {
+            return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+        }
+
+        inline void encode_capabilities(uint32_t capabilities, uint8_t* buf)
+        {
+            encode_u32(capabilities, buf);
+        }
+
+        //0 for a body too short to carry them, i.e. a peer that knows none
+        inline uint32_t decode_capabilities(const uint8_t* buf, uint32_t len)
+        {
+            if (len < capabilities_length)
+            {
+                return 0;
+            }
+            return decode_u32(buf);
+        }
+
+        //appends cmds to buf
+        inline void encode_cmds(const std::vector<uint32_t>& cmds, std::vector<uint8_t>& buf)
+        {
+            auto pos = buf.size();
+            buf.resize(pos + cmds.size() * sizeof(uint32_t));
+            for (auto cmd : cmds)
+            {
+                encode_u32(cmd, buf.data() + pos);
+                pos += sizeof(uint32_t);
+            }
+        }
+
+        //a trailing piece shorter than a cmd is ignored
+        inline std::vector<uint32_t> decode_cmds(const uint8_t* buf, uint32_t len)
+        {
+            std::vector<uint32_t> cmds;
+            for (uint32_t pos = 0; pos + sizeof(uint32_t) <= len; pos += sizeof(uint32_t))
+            {
+                cmds.push_back(decode_u32(buf + pos));
+            }
+            return cmds;
+        }
+    }
+}
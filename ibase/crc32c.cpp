@@ -0,0 +1,247 @@
+#include "crc32c.hpp"
+#include <string.h>
+
+//the word at a time loops take the first byte as the lowest one, a big endian target goes byte by byte
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define IBASE_CRC32C_BIG_ENDIAN
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define IBASE_CRC32C_X86
+#include <cpuid.h>
+#include <nmmintrin.h>
+#define IBASE_CRC32C_TARGET __attribute__((target("sse4.2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define IBASE_CRC32C_X86
+#include <intrin.h>
+#include <nmmintrin.h>
+#define IBASE_CRC32C_TARGET
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32) && !defined(IBASE_CRC32C_BIG_ENDIAN)
+#define IBASE_CRC32C_ARM
+#include <arm_acle.h>
+#endif
+
+namespace ibase
+{
+    namespace crc32c
+    {
+        namespace
+        {
+            constexpr uint32_t poly = 0x82f63b78;
+
+            struct tables_t
+            {
+                uint32_t t_[8][256];
+
+                tables_t()
+                {
+                    for (uint32_t i = 0; i < 256; ++i)
+                    {
+                        uint32_t crc = i;
+                        for (int k = 0; k < 8; ++k)
+                        {
+                            crc = (crc & 1) ? (crc >> 1) ^ poly : (crc >> 1);
+                        }
+                        t_[0][i] = crc;
+                    }
+
+                    for (uint32_t i = 0; i < 256; ++i)
+                    {
+                        for (int k = 1; k < 8; ++k)
+                        {
+                            t_[k][i] = (t_[k - 1][i] >> 8) ^ t_[0][t_[k - 1][i] & 0xff];
+                        }
+                    }
+                }
+            };
+
+            const tables_t& tables()
+            {
+                static const tables_t tables;
+                return tables;
+            }
+
+            inline uint64_t load_u64(const uint8_t* p)
+            {
+                uint64_t v;
+                memcpy(&v, p, sizeof(v));
+                return v;
+            }
+
+            //raw (not inverted) state in and out
+            uint32_t extend_sw(uint32_t state, const uint8_t* data, size_t len)
+            {
+                const auto& t = tables().t_;
+#if !defined(IBASE_CRC32C_BIG_ENDIAN)
+                while (len > 0 && ((uintptr_t)data & 7) != 0)
+                {
+                    state = (state >> 8) ^ t[0][(state ^ *data++) & 0xff];
+                    --len;
+                }
+
+                while (len >= 8)
+                {
+                    //slicing-by-8, the word is loaded little endian
+                    uint64_t v = load_u64(data) ^ state;
+                    state = t[7][v & 0xff] ^ t[6][(v >> 8) & 0xff] ^ t[5][(v >> 16) & 0xff] ^ t[4][(v >> 24) & 0xff]
+                          ^ t[3][(v >> 32) & 0xff] ^ t[2][(v >> 40) & 0xff] ^ t[1][(v >> 48) & 0xff] ^ t[0][v >> 56];
+                    data += 8;
+                    len -= 8;
+                }
+#endif
+
+                while (len > 0)
+                {
+                    state = (state >> 8) ^ t[0][(state ^ *data++) & 0xff];
+                    --len;
+                }
+                return state;
+            }
+
+#if defined(IBASE_CRC32C_X86)
+            bool detect_sse42()
+            {
+#if defined(_MSC_VER)
+                int info[4] = {0};
+                __cpuid(info, 1);
+                return (info[2] & (1 << 20)) != 0;
+#else
+                unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+                if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+                {
+                    return false;
+                }
+                return (ecx & bit_SSE4_2) != 0;
+#endif
+            }
+
+            IBASE_CRC32C_TARGET uint32_t extend_hw(uint32_t state, const uint8_t* data, size_t len)
+            {
+                while (len > 0 && ((uintptr_t)data & 7) != 0)
+                {
+                    state = _mm_crc32_u8(state, *data++);
+                    --len;
+                }
+#if defined(__x86_64__) || defined(_M_X64)
+                uint64_t state64 = state;
+                while (len >= 8)
+                {
+                    state64 = _mm_crc32_u64(state64, load_u64(data));
+                    data += 8;
+                    len -= 8;
+                }
+                state = (uint32_t)state64;
+#endif
+                while (len > 0)
+                {
+                    state = _mm_crc32_u8(state, *data++);
+                    --len;
+                }
+                return state;
+            }
+
+            IBASE_CRC32C_TARGET uint32_t copy_and_extend_hw(uint32_t state, uint8_t* dst, const uint8_t* src, size_t len)
+            {
+#if defined(__x86_64__) || defined(_M_X64)
+                uint64_t state64 = state;
+                while (len >= 8)
+                {
+                    uint64_t v = load_u64(src);
+                    memcpy(dst, &v, sizeof(v));
+                    state64 = _mm_crc32_u64(state64, v);
+                    src += 8;
+                    dst += 8;
+                    len -= 8;
+                }
+                state = (uint32_t)state64;
+#endif
+                while (len > 0)
+                {
+                    *dst = *src;
+                    state = _mm_crc32_u8(state, *src);
+                    ++src;
+                    ++dst;
+                    --len;
+                }
+                return state;
+            }
+
+            const bool has_hw = detect_sse42();
+#elif defined(IBASE_CRC32C_ARM)
+            uint32_t extend_hw(uint32_t state, const uint8_t* data, size_t len)
+            {
+                while (len >= 8)
+                {
+                    state = __crc32cd(state, load_u64(data));
+                    data += 8;
+                    len -= 8;
+                }
+                while (len > 0)
+                {
+                    state = __crc32cb(state, *data++);
+                    --len;
+                }
+                return state;
+            }
+
+            uint32_t copy_and_extend_hw(uint32_t state, uint8_t* dst, const uint8_t* src, size_t len)
+            {
+                while (len >= 8)
+                {
+                    uint64_t v = load_u64(src);
+                    memcpy(dst, &v, sizeof(v));
+                    state = __crc32cd(state, v);
+                    src += 8;
+                    dst += 8;
+                    len -= 8;
+                }
+                while (len > 0)
+                {
+                    *dst = *src;
+                    state = __crc32cb(state, *src);
+                    ++src;
+                    ++dst;
+                    --len;
+                }
+                return state;
+            }
+
+            const bool has_hw = true;
+#endif
+        }
+
+        uint32_t extend(uint32_t crc, const uint8_t* data, size_t len)
+        {
+            uint32_t state = ~crc;
+#if defined(IBASE_CRC32C_X86) || defined(IBASE_CRC32C_ARM)
+            if (has_hw)
+            {
+                return ~extend_hw(state, data, len);
+            }
+#endif
+            return ~extend_sw(state, data, len);
+        }
+
+        uint32_t copy_and_extend(uint32_t crc, uint8_t* dst, const uint8_t* src, size_t len)
+        {
+            uint32_t state = ~crc;
+#if defined(IBASE_CRC32C_X86) || defined(IBASE_CRC32C_ARM)
+            if (has_hw)
+            {
+                return ~copy_and_extend_hw(state, dst, src, len);
+            }
+#endif
+            memcpy(dst, src, len);
+            return ~extend_sw(state, dst, len);
+        }
+
+        bool hardware_accelerated()
+        {
+#if defined(IBASE_CRC32C_X86) || defined(IBASE_CRC32C_ARM)
+            return has_hw;
+#else
+            return false;
+#endif
+        }
+    }
+}
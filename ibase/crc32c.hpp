@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ibase
+{
+    //crc32c (castagnoli). uses the sse4.2 / armv8 crc32 instructions when the cpu has them,
+    //slicing-by-8 tables otherwise
+    namespace crc32c
+    {
+        //continue a crc over more data, start with crc = 0
+        uint32_t extend(uint32_t crc, const uint8_t* data, size_t len);
+        //copy src to dst and extend crc over the copied bytes in the same pass
+        uint32_t copy_and_extend(uint32_t crc, uint8_t* dst, const uint8_t* src, size_t len);
+        bool hardware_accelerated();
+
+        inline uint32_t value(const uint8_t* data, size_t len)
+        {
+            return extend(0, data, len);
+        }
+    }
+}
@@ -1,9 +1,15 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
 #include <memory>
 #include <functional>
 
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 namespace bev {
 
 // # IO Buffer
@@ -59,6 +65,16 @@ namespace bev {
 // The class `io_buffer_view` can be used to treat an existing memory region as an
 // `io_buffer` without assuming ownership of the underlying memory.
 //
+//
+// # Mirrored Storage
+//
+// An `io_buffer` constructed with `storage_t::mirrored` maps the same pages twice,
+// back to back, the way `linear_ringbuffer` does. Bytes written past the end of the
+// first mapping show up at its start, so the readable region is always contiguous
+// and `prepare()` never has to move unread data to the front. Where the mapping is
+// not available (outside Linux, or when the kernel refuses), the buffer silently
+// falls back to flat storage.
+//
 
 using std::size_t;
 
@@ -77,21 +93,24 @@ public:
     io_buffer_view() noexcept = default;
 
 
-    inline io_buffer_view(uint8_t* data, size_t size) noexcept
+    // `mirrored` means `data + size` aliases `data` for another `size` bytes.
+    inline io_buffer_view(uint8_t* data, size_t size, bool mirrored = false) noexcept
       : buffer_(data)
       , length_(size)
       , head_(0)
       , tail_(0)
+      , mirrored_(mirrored)
     {
     }
 
 
-    inline void assign(uint8_t* data, size_t size) noexcept
+    inline void assign(uint8_t* data, size_t size, bool mirrored = false) noexcept
     {
         buffer_ = data;
         length_ = size;
         head_ = 0;
         tail_ = 0;
+        mirrored_ = mirrored;
     }
 
 
@@ -121,14 +140,21 @@ public:
 
     inline size_t free_size() const noexcept
     {
-        return length_ - tail_;
+        // With mirrored storage all free space is behind the tail.
+        return mirrored_ ? length_ - this->size() : length_ - tail_;
+    }
+
+
+    inline bool mirrored() const noexcept
+    {
+        return mirrored_;
     }
 
 
     inline slab prepare(size_t n) noexcept
     {
         // Make as much room as we can
-        if (n > this->free_size()) {
+        if (n > this->free_size() && !mirrored_) {
             std::size_t size = tail_ - head_;
             ::memmove(buffer_, buffer_ + head_, size);
             tail_ = size;
@@ -157,6 +183,10 @@ public:
         head_ += n;
         if (head_ >= tail_) {
             head_ = tail_ = 0;
+        } else if (head_ >= length_) {
+            // Only reachable with mirrored storage, continue in the first mapping.
+            head_ -= length_;
+            tail_ -= length_;
         }
     }
 
@@ -171,23 +201,102 @@ private:
     size_t length_;
     size_t head_;
     size_t tail_;
+    bool mirrored_;
 };
 
 
 namespace detail {
 
+// Maps `size` bytes twice back to back, `size` must be a multiple of the page size.
+// Returns nullptr if that is not possible on this platform.
+inline uint8_t* map_mirrored(size_t size) noexcept
+{
+#if defined(__linux__)
+    int fd = ::memfd_create("bev_io_buffer", MFD_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    if (::ftruncate(fd, size) != 0) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    // Reserve the address range for both halves first, then map the file over it twice.
+    void* base = ::mmap(nullptr, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    uint8_t* data = static_cast<uint8_t*>(base);
+    bool mapped = ::mmap(data, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED
+        && ::mmap(data + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED;
+    ::close(fd);
+
+    if (!mapped) {
+        ::munmap(base, 2 * size);
+        return nullptr;
+    }
+    return data;
+#else
+    (void)size;
+    return nullptr;
+#endif
+}
+
+
+inline void unmap_mirrored(uint8_t* data, size_t size) noexcept
+{
+#if defined(__linux__)
+    ::munmap(data, 2 * size);
+#else
+    (void)data;
+    (void)size;
+#endif
+}
+
+
+inline size_t round_to_pages(size_t size) noexcept
+{
+#if defined(__linux__)
+    size_t page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+#else
+    size_t page_size = 4096;
+#endif
+    return (size + page_size - 1) / page_size * page_size;
+}
+
+
 // Class `io_buffer_storage` holds a pointer to the allocated memory region along
 // with a type-erased deleter.
 class io_buffer_storage
 {
 public:
-    io_buffer_storage(std::unique_ptr<uint8_t[]> storage)
+    using buffer_ptr = std::unique_ptr<uint8_t[], std::function<void(uint8_t*)>>;
+
+    io_buffer_storage(size_t size, bool mirrored)
+      : size_(size)
+      , mirrored_(false)
     {
-        buffer_ = std::move(storage);
+        if (mirrored) {
+            size_t mapped_size = round_to_pages(size);
+            uint8_t* data = map_mirrored(mapped_size);
+            if (data != nullptr) {
+                buffer_ = buffer_ptr(data, [mapped_size](uint8_t* p) { unmap_mirrored(p, mapped_size); });
+                size_ = mapped_size;
+                mirrored_ = true;
+                return;
+            }
+        }
+
+        buffer_ = buffer_ptr(new uint8_t[size](), [](uint8_t* p) { delete[] p; });
     }
 
 protected:
-    std::unique_ptr<uint8_t[]> buffer_;
+    buffer_ptr buffer_;
+    size_t size_;
+    bool mirrored_;
 };
 
 } // namespace detail
@@ -199,9 +308,16 @@ class io_buffer
   , public io_buffer_view
 {
 public:
-    io_buffer(size_t size)
-      : detail::io_buffer_storage(std::make_unique<uint8_t[]>(size))
-      , io_buffer_view(this->detail::io_buffer_storage::buffer_.get(), size)
+    enum class storage_t {
+        flat,
+        mirrored,   // rounded up to whole pages
+    };
+
+    io_buffer(size_t size, storage_t storage = storage_t::flat)
+      : detail::io_buffer_storage(size, storage == storage_t::mirrored)
+      , io_buffer_view(this->detail::io_buffer_storage::buffer_.get(),
+                       this->detail::io_buffer_storage::size_,
+                       this->detail::io_buffer_storage::mirrored_)
     {
     }
 };
@@ -0,0 +1,46 @@
+#include "ithread_pool.hpp"
+#include <algorithm>
+
+namespace ibase {
+
+    ithread_pool::ithread_pool(uint32_t thread_count)
+        : io_context_((int)std::max(thread_count, 1u))
+        , work_guard_(io_context_.get_executor())
+    {
+        for (uint32_t i = 0; i < std::max(thread_count, 1u); ++i)
+        {
+            threads_.emplace_back([this]()
+            {
+                io_context_.run();
+            });
+        }
+    }
+
+    ithread_pool::~ithread_pool()
+    {
+        stop();
+    }
+
+    void ithread_pool::stop()
+    {
+        io_context_.stop();
+        for (auto& t : threads_)
+        {
+            if (t.joinable())
+            {
+                t.join();
+            }
+        }
+    }
+
+    uint32_t ithread_pool::size() const noexcept
+    {
+        return (uint32_t)threads_.size();
+    }
+
+    asio::io_context& ithread_pool::get_io_context() noexcept
+    {
+        return io_context_;
+    }
+
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <thread>
+#include <vector>
+#include <asio.hpp>
+
+namespace ibase
+{
+    //one io_context run by a number of threads. whichever thread is free takes the next ready handler, so a
+    //thread stuck in a slow one holds up nothing else. handlers that must not overlap go through a strand
+    class ithread_pool final
+    {
+    public:
+        explicit ithread_pool(uint32_t thread_count);
+        ~ithread_pool();
+
+        //handlers not started yet are dropped
+        void stop();
+        uint32_t size() const noexcept;
+        asio::io_context& get_io_context() noexcept;
+
+    private:
+        asio::io_context io_context_;
+        asio::executor_work_guard<asio::io_context::executor_type> work_guard_;
+        std::vector<std::thread> threads_;
+    };
+}
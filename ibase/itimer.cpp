@@ -5,6 +5,7 @@ namespace ibase {
 
     itimer::itimer(asio::io_context& io_context)
     : io_context_(io_context)
+    , wheel_(timer_wheel_t::of(io_context))
     {
 
     }
@@ -14,117 +15,51 @@ namespace ibase {
 
     }
 
-    uint32_t itimer::start_timer(std::function<void()> task, uint32_t delay_seconds, uint32_t interval_seconds)
+    uint32_t itimer::start_timer(small_task_t<> task, uint32_t delay_seconds, uint32_t interval_seconds)
     {
-        auto timer_id = ++cur_timer_id_;
-        std::weak_ptr<itimer> weak_this(shared_from_this());
-        ibase::task::run_task_in_the_iocontext_async(io_context_, [weak_this, timer_id, task, delay_seconds, interval_seconds]() {
-            auto shared_this = weak_this.lock();
-            if (!shared_this)
-            {
-                return;
-            }
-
-            shared_this->start_timer_impl(timer_id, task, delay_seconds, interval_seconds);
-        });
-
-        return timer_id;
+        return start_timer(std::move(task), std::chrono::seconds(delay_seconds), std::chrono::seconds(interval_seconds));
     }
 
-    void itimer::stop_timer(uint32_t timer_id)
+    uint32_t itimer::start_timer(small_task_t<> task, std::chrono::milliseconds delay, std::chrono::milliseconds interval)
     {
+        auto& wheel = wheel_;
+        auto timer_id = wheel.next_timer_id();
         std::weak_ptr<itimer> weak_this(shared_from_this());
-        ibase::task::run_task_in_the_iocontext_async(io_context_, [weak_this, timer_id]() {
+        //the wheel lives as long as the io_context, a timer that outlived its itimer stops itself
+        small_task_t<> guarded_task = [weak_this, task = std::move(task), &wheel, timer_id]() {
             auto shared_this = weak_this.lock();
             if (!shared_this)
             {
+                wheel.cancel(timer_id);
                 return;
             }
 
-            shared_this->stop_timer_impl(timer_id);
-        });
-    }
+            task();
+        };
 
-    void itimer::start_timer_impl(uint32_t timer_id, std::function<void()> task, uint32_t delay_seconds, uint32_t interval_seconds)
-    {
-        timer_info_t timer_info{ std::make_shared<asio::steady_timer>(io_context_), task, delay_seconds, interval_seconds };
-        timers_[timer_id] = timer_info;
-        
-        async_wait_after(timer_id, interval_seconds);
-    }
-
-    void itimer::stop_timer_impl(uint32_t timer_id)
-    {
-        auto it = timers_.find(timer_id);
-
-        if (it == timers_.end())
+        if (io_context_.get_executor().running_in_this_thread())
         {
-            return;
+            wheel.schedule(timer_id, std::move(guarded_task), delay, interval);
+            return timer_id;
         }
 
-        std::error_code rc;
-        it->second.timer_->cancel(rc);
-
-        timers_.erase(it);
-    }
-
-    void itimer::on_timer(uint32_t timer_id)
-    {
-        auto it = timers_.find(timer_id);
-
-        if (it == timers_.end())
-        {
-            return;
-        }
-
-        //callback
-        it->second.task_();
-        reschedule_timer(it->first);
-    }
-
-    void itimer::reschedule_timer(uint32_t timer_id)
-    {
-        auto it = timers_.find(timer_id);
-
-        if (it == timers_.end())
-        {
-            return;
-        }
+        asio::post(io_context_, [&wheel, timer_id, guarded_task = std::move(guarded_task), delay, interval]() mutable {
+            wheel.schedule(timer_id, std::move(guarded_task), delay, interval);
+        });
 
-        //remove or reschedule
-        if (it->second.interval_seconds_ == 0)
-        {
-            timers_.erase(it);
-        }
-        else
-        {
-            async_wait_after(timer_id, it->second.interval_seconds_);
-        }
+        return timer_id;
     }
 
-    void itimer::async_wait_after(uint32_t timer_id, uint32_t seconds)
+    void itimer::stop_timer(uint32_t timer_id)
     {
-        auto it = timers_.find(timer_id);
-        if (it == timers_.end())
+        if (timer_id == 0)
         {
             return;
         }
 
-        it->second.timer_->expires_after(std::chrono::seconds(it->second.interval_seconds_));
-
-        std::weak_ptr<itimer> weak_this(shared_from_this());
-        it->second.timer_->async_wait([weak_this, timer_id](const asio::error_code& ec) {
-            if (ec)
-            {
-                return;
-            }
-
-            auto shared_this = weak_this.lock();
-            if (!shared_this)
-            {
-                return;
-            }
-            shared_this->on_timer(timer_id);
+        auto& wheel = wheel_;
+        ibase::task::run_task_in_the_iocontext(io_context_, [&wheel, timer_id]() {
+            wheel.cancel(timer_id);
         });
     }
 }
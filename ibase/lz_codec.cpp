@@ -0,0 +1,252 @@
+#include "lz_codec.hpp"
+#include <string.h>
+
+namespace ibase
+{
+    namespace
+    {
+        inline uint32_t load_u32(const uint8_t* p)
+        {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint64_t load_u64(const uint8_t* p)
+        {
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        bool write_length(uint8_t*& op, const uint8_t* op_end, uint32_t len)
+        {
+            while (len >= 255)
+            {
+                if (op >= op_end)
+                {
+                    return false;
+                }
+                *op++ = 255;
+                len -= 255;
+            }
+
+            if (op >= op_end)
+            {
+                return false;
+            }
+            *op++ = (uint8_t)len;
+            return true;
+        }
+
+        bool read_length(const uint8_t*& ip, const uint8_t* ip_end, uint32_t& len)
+        {
+            uint8_t b = 0;
+            do {
+                if (ip >= ip_end)
+                {
+                    return false;
+                }
+                b = *ip++;
+                if (len > 0xffffffffu - b)
+                {
+                    return false;
+                }
+                len += b;
+            } while (b == 255);
+            return true;
+        }
+
+        //match_len 0 writes the trailing literals only sequence
+        bool write_sequence(uint8_t*& op, const uint8_t* op_end, const uint8_t* literals, uint32_t literal_len, uint32_t offset, uint32_t match_len, uint32_t min_match)
+        {
+            uint32_t match_code = (match_len > 0) ? match_len - min_match : 0;
+            if (op >= op_end)
+            {
+                return false;
+            }
+            *op++ = (uint8_t)(((literal_len < 15 ? literal_len : 15) << 4) | (match_code < 15 ? match_code : 15));
+
+            if ((literal_len >= 15) && !write_length(op, op_end, literal_len - 15))
+            {
+                return false;
+            }
+
+            if (literal_len > (uint32_t)(op_end - op))
+            {
+                return false;
+            }
+            memcpy(op, literals, literal_len);
+            op += literal_len;
+
+            if (match_len == 0)
+            {
+                return true;
+            }
+
+            if (op_end - op < 2)
+            {
+                return false;
+            }
+            *op++ = (uint8_t)(offset & 0xff);
+            *op++ = (uint8_t)(offset >> 8);
+
+            if ((match_code >= 15) && !write_length(op, op_end, match_code - 15))
+            {
+                return false;
+            }
+            return true;
+        }
+    }
+
+    uint8_t lz_codec_t::id() const
+    {
+        return codec::lz_codec_id;
+    }
+
+    uint32_t lz_codec_t::max_compressed_length(uint32_t raw_len) const
+    {
+        return raw_len + raw_len / 255 + 16;
+    }
+
+    uint32_t lz_codec_t::compress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_capacity) const
+    {
+        //positions + 1 of the last occurrence of each 4 byte hash, 0 means empty. small inputs only
+        //clear the part of the table they can fill
+        uint32_t table[1 << hash_log];
+        uint32_t table_log = 8;
+        while ((table_log < hash_log) && ((1u << table_log) < src_len))
+        {
+            ++table_log;
+        }
+        memset(table, 0, sizeof(uint32_t) << table_log);
+
+        uint8_t* op = dst;
+        const uint8_t* op_end = dst + dst_capacity;
+        uint32_t anchor = 0;
+        uint32_t ip = 0;
+        uint32_t misses = 0;
+        while (ip + min_match <= src_len)
+        {
+            uint32_t sequence = load_u32(src + ip);
+            uint32_t hash = (sequence * 2654435761u) >> (32 - table_log);
+            uint32_t ref = table[hash];
+            table[hash] = ip + 1;
+
+            if ((ref == 0) || (ip - (ref - 1) > max_offset) || (load_u32(src + ref - 1) != sequence))
+            {
+                //step faster through data that does not compress
+                ip += 1 + (misses++ >> 5);
+                continue;
+            }
+
+            ref -= 1;
+            uint32_t match_len = min_match;
+            while ((ip + match_len + 8 <= src_len) && (load_u64(src + ref + match_len) == load_u64(src + ip + match_len)))
+            {
+                match_len += 8;
+            }
+            while ((ip + match_len < src_len) && (src[ref + match_len] == src[ip + match_len]))
+            {
+                ++match_len;
+            }
+
+            if (!write_sequence(op, op_end, src + anchor, ip - anchor, ip - ref, match_len, min_match))
+            {
+                return 0;
+            }
+            ip += match_len;
+            anchor = ip;
+            misses = 0;
+        }
+
+        if (!write_sequence(op, op_end, src + anchor, src_len - anchor, 0, 0, min_match))
+        {
+            return 0;
+        }
+        return (uint32_t)(op - dst);
+    }
+
+    bool lz_codec_t::decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len) const
+    {
+        const uint8_t* ip = src;
+        const uint8_t* ip_end = src + src_len;
+        uint8_t* op = dst;
+        uint8_t* op_end = dst + dst_len;
+        do {
+            if (ip >= ip_end)
+            {
+                return false;
+            }
+            uint8_t token = *ip++;
+
+            uint32_t literal_len = token >> 4;
+            if ((literal_len == 15) && !read_length(ip, ip_end, literal_len))
+            {
+                return false;
+            }
+            if ((literal_len > (uint32_t)(ip_end - ip)) || (literal_len > (uint32_t)(op_end - op)))
+            {
+                return false;
+            }
+            memcpy(op, ip, literal_len);
+            ip += literal_len;
+            op += literal_len;
+
+            if (ip == ip_end)
+            {
+                //the literals only sequence ends the block
+                return op == op_end;
+            }
+
+            if (ip_end - ip < 2)
+            {
+                return false;
+            }
+            uint32_t offset = ip[0] | (ip[1] << 8);
+            ip += 2;
+            if ((offset == 0) || (offset > (uint32_t)(op - dst)))
+            {
+                return false;
+            }
+
+            uint32_t match_len = token & 15;
+            if ((match_len == 15) && !read_length(ip, ip_end, match_len))
+            {
+                return false;
+            }
+            if ((uint64_t)match_len + min_match > (uint64_t)(op_end - op))
+            {
+                return false;
+            }
+            match_len += min_match;
+
+            const uint8_t* match = op - offset;
+            if (offset >= match_len)
+            {
+                memcpy(op, match, match_len);
+                op += match_len;
+            }
+            else
+            {
+                //overlapping copy repeats the last offset bytes, 8 at a time while they do not overlap
+                uint8_t* match_end = op + match_len;
+                if (offset >= 8)
+                {
+                    while (match_end - op >= 8)
+                    {
+                        memcpy(op, match, 8);
+                        op += 8;
+                        match += 8;
+                    }
+                }
+                while (op < match_end)
+                {
+                    *op++ = *match++;
+                }
+            }
+        } while (1);
+
+        return false;
+    }
+}
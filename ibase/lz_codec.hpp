@@ -0,0 +1,21 @@
+#pragma once
+#include "codec.hpp"
+
+namespace ibase
+{
+    //byte oriented lz77 in the spirit of lz4 block format. every sequence is a token (literal length
+    //nibble, match length - 4 nibble), extra length bytes, the literals, a 2 byte little endian offset
+    //and extra match length bytes. the last sequence has literals only
+    class lz_codec_t : public codec_t
+    {
+        constexpr static uint32_t min_match = 4;
+        constexpr static uint32_t hash_log = 12;
+        constexpr static uint32_t max_offset = 65535;
+
+    public:
+        uint8_t id() const override;
+        uint32_t max_compressed_length(uint32_t raw_len) const override;
+        uint32_t compress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_capacity) const override;
+        bool decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len) const override;
+    };
+}
@@ -0,0 +1,118 @@
+#include "message_reassembler.hpp"
+#include <cstring>
+#include <fmt/core.h>
+#include "ilogger.hpp"
+
+namespace ibase
+{
+    message_reassembler_t::message_reassembler_t(uint32_t max_buffered_bytes)
+    : max_buffered_bytes_(max_buffered_bytes)
+    {
+    }
+
+    std::shared_ptr<packet_t> message_reassembler_t::on_fragment(const packet_view_t& fragment)
+    {
+        auto id = message_id(fragment);
+        auto total_length = fragment.fragment_total_length();
+        auto offset = fragment.fragment_offset();
+
+        if (offset == 0)
+        {
+            //a new message, replaces a partial one left behind by a resend
+            skipped_messages_.erase(id);
+            auto it = pending_messages_.find(id);
+            if (it != pending_messages_.end())
+            {
+                drop(it);
+            }
+
+            if ((total_length > packet_t::max_message_length) || (buffered_bytes_ + total_length > max_buffered_bytes_))
+            {
+                ibase::logger::write_log(ibase::logger::log_level_warn, fmt::format("drop fragmented message, cmd = {}, seq = {}, length = {}, buffered = {}", fragment.cmd(), fragment.seq(), total_length, buffered_bytes_));
+                skip(fragment);
+                return nullptr;
+            }
+
+            pending_message_t message;
+            message.packet_ = packet_t::allocate_packet(fragment.cmd(), fragment.seq(), fragment.is_push(), total_length);
+            pending_messages_[id] = message;
+            buffered_bytes_ += total_length;
+        }
+
+        auto it = pending_messages_.find(id);
+        if (it == pending_messages_.end())
+        {
+            return nullptr;
+        }
+
+        auto& message = it->second;
+        auto data_length = fragment.fragment_data_length();
+        if ((offset != message.received_) || (total_length != message.packet_->body_length()) || (data_length > total_length - offset))
+        {
+            drop(it);
+            return nullptr;
+        }
+
+        memcpy(message.packet_->body() + offset, fragment.fragment_data(), data_length);
+        message.received_ += data_length;
+        if (message.received_ < total_length)
+        {
+            return nullptr;
+        }
+
+        auto packet = std::move(message.packet_);
+        buffered_bytes_ -= total_length;
+        pending_messages_.erase(it);
+        return packet;
+    }
+
+    void message_reassembler_t::skip(const packet_view_t& fragment)
+    {
+        if (fragment.is_last_fragment())
+        {
+            return;
+        }
+
+        skipped_messages_.insert(message_id(fragment));
+    }
+
+    bool message_reassembler_t::skipping(const packet_view_t& fragment)
+    {
+        auto it = skipped_messages_.find(message_id(fragment));
+        if (it == skipped_messages_.end())
+        {
+            return false;
+        }
+
+        if (fragment.is_last_fragment())
+        {
+            skipped_messages_.erase(it);
+        }
+        return true;
+    }
+
+    void message_reassembler_t::clear()
+    {
+        pending_messages_.clear();
+        skipped_messages_.clear();
+        buffered_bytes_ = 0;
+    }
+
+    uint32_t message_reassembler_t::buffered_bytes() const
+    {
+        return buffered_bytes_;
+    }
+
+    uint64_t message_reassembler_t::message_id(const packet_view_t& fragment)
+    {
+        uint64_t id = fragment.cmd();
+        id = (id << 32)|fragment.seq();
+        return id;
+    }
+
+    void message_reassembler_t::drop(map_id_2_pending_message_t::iterator it)
+    {
+        buffered_bytes_ -= it->second.packet_->body_length();
+        pending_messages_.erase(it);
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <map>
+#include <set>
+#include <memory>
+#include "packet.hpp"
+
+namespace ibase
+{
+    //puts fragmented messages back together. fragments of one message arrive in order on one connection,
+    //memory held by unfinished messages is capped. not thread safe
+    class message_reassembler_t
+    {
+        struct pending_message_t
+        {
+            std::shared_ptr<packet_t> packet_;
+            uint32_t received_{0};
+        };
+
+        using map_id_2_pending_message_t = std::map<uint64_t, pending_message_t>;
+        using message_id_set_t = std::set<uint64_t>;
+
+    public:
+        constexpr static uint32_t default_max_buffered_bytes = 32*1024*1024;
+
+    public:
+        message_reassembler_t(uint32_t max_buffered_bytes = default_max_buffered_bytes);
+
+        //returns the whole message once its last fragment arrived
+        std::shared_ptr<packet_t> on_fragment(const packet_view_t& fragment);
+        //ignore the rest of the message this fragment starts, e.g. a retransmitted duplicate
+        void skip(const packet_view_t& fragment);
+        //true if the fragment belongs to a skipped message
+        bool skipping(const packet_view_t& fragment);
+        void clear();
+
+        uint32_t buffered_bytes() const;
+    private:
+        uint64_t message_id(const packet_view_t& fragment);
+        void drop(map_id_2_pending_message_t::iterator it);
+    private:
+        uint32_t                            max_buffered_bytes_;
+        uint32_t                            buffered_bytes_{0};
+        map_id_2_pending_message_t          pending_messages_;
+        message_id_set_t                    skipped_messages_;
+    };
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <utility>
+
+namespace ibase
+{
+    //unbounded lock-free queue for many producers and one consumer. a push is one exchange and one store,
+    //so producers never wait for each other or for the consumer. a push that is half done when the
+    //consumer gets there is picked up by its next pop, pop() reports empty until then
+    template<typename value_t>
+    class mpsc_queue_t
+    {
+        struct node_t
+        {
+            std::atomic<node_t*> next_{nullptr};
+            value_t value_;
+        };
+    public:
+        mpsc_queue_t()
+            : head_(&stub_)
+            , tail_(&stub_)
+        {
+        }
+
+        ~mpsc_queue_t()
+        {
+            value_t value;
+            while (pop(value))
+            {
+            }
+            if (tail_ != &stub_)
+            {
+                delete tail_;
+            }
+        }
+
+        //any thread
+        void push(value_t value)
+        {
+            auto node = new node_t;
+            node->value_ = std::move(value);
+            auto prev = head_.exchange(node, std::memory_order_acq_rel);
+            prev->next_.store(node, std::memory_order_release);
+        }
+
+        //the consumer thread only
+        bool pop(value_t& value)
+        {
+            //tail_ is a node whose value was taken already, the next one holds the oldest value
+            auto tail = tail_;
+            auto next = tail->next_.load(std::memory_order_acquire);
+            if (next == nullptr)
+            {
+                return false;
+            }
+
+            value = std::move(next->value_);
+            next->value_ = value_t();
+            tail_ = next;
+            if (tail != &stub_)
+            {
+                delete tail;
+            }
+            return true;
+        }
+    private:
+        mpsc_queue_t(const mpsc_queue_t& other) = delete;
+        mpsc_queue_t& operator=(const mpsc_queue_t& other) = delete;
+    private:
+        node_t                  stub_;
+        std::atomic<node_t*>    head_;
+        node_t*                 tail_;
+    };
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace ibase
+{
+    //bounded lock-free ring for many producers and one consumer. the slots are made once up front and the
+    //values are moved in and out of them, a push allocates nothing. every slot carries a sequence that tells
+    //whether it is free for the producer at a position or filled for the consumer, producers claim positions
+    //with a compare exchange
+    template<typename value_t>
+    class mpsc_ring_t
+    {
+        struct slot_t
+        {
+            std::atomic<uint64_t> sequence_;
+            value_t value_;
+        };
+    public:
+        //rounded up to a power of 2
+        explicit mpsc_ring_t(uint32_t capacity)
+        {
+            uint32_t size = 2;
+            while (size < capacity)
+            {
+                size *= 2;
+            }
+            mask_ = size - 1;
+            slots_.reset(new slot_t[size]);
+            for (uint32_t i = 0; i < size; ++i)
+            {
+                slots_[i].sequence_.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        uint32_t capacity() const
+        {
+            return mask_ + 1;
+        }
+
+        //any thread. moves the value in and returns true, or leaves it alone if the ring is full
+        bool try_push(value_t& value)
+        {
+            auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                auto& slot = slots_[pos & mask_];
+                auto sequence = slot.sequence_.load(std::memory_order_acquire);
+                auto diff = (int64_t)sequence - (int64_t)pos;
+                if (diff == 0)
+                {
+                    if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        slot.value_ = std::move(value);
+                        slot.sequence_.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    //the consumer has not taken the value a lap ago yet
+                    return false;
+                }
+                else
+                {
+                    pos = enqueue_pos_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        //the consumer thread only
+        bool try_pop(value_t& value)
+        {
+            auto& slot = slots_[dequeue_pos_ & mask_];
+            if (slot.sequence_.load(std::memory_order_acquire) != dequeue_pos_ + 1)
+            {
+                return false;
+            }
+
+            value = std::move(slot.value_);
+            slot.value_ = value_t();
+            slot.sequence_.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+            ++dequeue_pos_;
+            return true;
+        }
+
+        //the consumer thread only. a push still under way counts as not there yet
+        bool empty() const
+        {
+            return slots_[dequeue_pos_ & mask_].sequence_.load(std::memory_order_acquire) != dequeue_pos_ + 1;
+        }
+    private:
+        mpsc_ring_t(const mpsc_ring_t& other) = delete;
+        mpsc_ring_t& operator=(const mpsc_ring_t& other) = delete;
+    private:
+        std::unique_ptr<slot_t[]>           slots_;
+        uint32_t                            mask_{0};
+        //producers and the consumer each on their own cache line
+        alignas(64) std::atomic<uint64_t>   enqueue_pos_{0};
+        alignas(64) uint64_t                dequeue_pos_{0};
+    };
+}
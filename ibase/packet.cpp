@@ -1,8 +1,36 @@
 #include "packet.hpp"
+#include "packet_pool.hpp"
+#include "crc32c.hpp"
+#include "codec.hpp"
+#include "ibuffer.hpp"
 #include <asio.hpp>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#define IBASE_PACKET_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IBASE_PACKET_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 namespace ibase
 {
+    static inline uint32_t count_trailing_zeros(uint32_t mask)
+    {
+#if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanForward(&index, mask);
+        return index;
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
     static const uint8_t crc8_table[] =
     {
         0x00, 0x5e, 0xbc, 0xe2, 0x61, 0x3f, 0xdd, 0x83, 0xc2, 0x9c, 0x7e, 0x20, 0xa3, 0xfd, 0x1f, 0x41,
@@ -23,88 +51,567 @@ namespace ibase
         0x74, 0x2a, 0xc8, 0x96, 0x15, 0x4b, 0xa9, 0xf7, 0xb6, 0xe8, 0x0a, 0x54, 0xd7, 0x89, 0x6b, 0x35,
     };
 
-    std::shared_ptr<packet_t> packet_t::build_packet(uint32_t cmd, uint32_t seq, bool is_push, uint8_t* body_buf, uint32_t body_len)
+    packet_t::build_opt_t packet_t::default_build_opt{false, nullptr, default_compress_min_length};
+
+    std::shared_ptr<packet_t> packet_t::build_packet(uint32_t cmd, uint32_t seq, bool is_push, uint8_t* body_buf, uint32_t body_len, const build_opt_t* opt)
     {
-        if (header_length + body_len > max_body_length)
+        if (opt == nullptr)
+        {
+            opt = &default_build_opt;
+        }
+
+        if (body_len > max_body_length)
         {
             return nullptr;
         }
         
+        uint8_t flags = (is_push ? flag_push : 0) | (opt->body_checksum ? flag_body_crc32c : 0);
+        if (should_compress(*opt, body_len))
+        {
+            auto packet = build_compressed_packet(cmd, seq, flags, body_buf, body_len, *opt->codec);
+            if (packet)
+            {
+                return packet;
+            }
+        }
+
+        auto header = make_header(cmd, seq, flags, body_len);
+        return std::allocate_shared<packet_t>(packet_pool_allocator_t<packet_t>(), cmd, seq, header, body_buf, body_len);
+    }
+
+    std::vector<std::shared_ptr<packet_t>> packet_t::build_packets(uint32_t cmd, uint32_t seq, bool is_push, uint8_t* body_buf, uint32_t body_len, const build_opt_t* opt)
+    {
+        std::vector<std::shared_ptr<packet_t>> packets;
+        if (body_len <= max_body_length)
+        {
+            auto packet = build_packet(cmd, seq, is_push, body_buf, body_len, opt);
+            if (packet)
+            {
+                packets.push_back(packet);
+            }
+            return packets;
+        }
+
+        if (body_len > max_message_length)
+        {
+            return packets;
+        }
+
+        if (opt == nullptr)
+        {
+            opt = &default_build_opt;
+        }
+
+        uint8_t flags = (is_push ? flag_push : 0) | (opt->body_checksum ? flag_body_crc32c : 0);
+        build_fragments(cmd, seq, flags, nullptr, body_buf, body_len, packets);
+        return packets;
+    }
+
+    std::shared_ptr<packet_t> packet_t::build_packet(uint32_t cmd, uint32_t seq, bool is_push, std::shared_ptr<ibuffer> body, const build_opt_t* opt)
+    {
+        const uint8_t* body_buf = body ? body->buf() : nullptr;
+        uint32_t body_len = body ? body->len() : 0;
+        if (body_len > max_body_length)
+        {
+            return nullptr;
+        }
+
+        if (opt == nullptr)
+        {
+            opt = &default_build_opt;
+        }
+
+        uint8_t flags = (is_push ? flag_push : 0) | (opt->body_checksum ? flag_body_crc32c : 0);
+        if (should_compress(*opt, body_len))
+        {
+            auto packet = build_compressed_packet(cmd, seq, flags, body_buf, body_len, *opt->codec);
+            if (packet)
+            {
+                return packet;
+            }
+        }
+
+        auto header = make_header(cmd, seq, flags, body_len);
+        return std::allocate_shared<packet_t>(packet_pool_allocator_t<packet_t>(), cmd, seq, header, nullptr, 0, std::move(body), body_buf, body_len);
+    }
+
+    std::vector<std::shared_ptr<packet_t>> packet_t::build_packets(uint32_t cmd, uint32_t seq, bool is_push, std::shared_ptr<ibuffer> body, const build_opt_t* opt)
+    {
+        std::vector<std::shared_ptr<packet_t>> packets;
+        const uint8_t* body_buf = body ? body->buf() : nullptr;
+        uint32_t body_len = body ? body->len() : 0;
+        if (body_len <= max_body_length)
+        {
+            packets.push_back(build_packet(cmd, seq, is_push, std::move(body), opt));
+            return packets;
+        }
+
+        if (body_len > max_message_length)
+        {
+            return packets;
+        }
+
+        if (opt == nullptr)
+        {
+            opt = &default_build_opt;
+        }
+
+        uint8_t flags = (is_push ? flag_push : 0) | (opt->body_checksum ? flag_body_crc32c : 0);
+        build_fragments(cmd, seq, flags, body, body_buf, body_len, packets);
+        return packets;
+    }
+
+    void packet_t::build_fragments(uint32_t cmd, uint32_t seq, uint8_t flags, const std::shared_ptr<ibuffer>& body_owner, const uint8_t* body_buf, uint32_t body_len, std::vector<std::shared_ptr<packet_t>>& packets)
+    {
+        flags |= flag_fragment;
+        packets.reserve((body_len + max_fragment_payload_length - 1) / max_fragment_payload_length);
+        for (uint32_t offset = 0; offset < body_len; offset += max_fragment_payload_length)
+        {
+            uint32_t payload_len = std::min(max_fragment_payload_length, body_len - offset);
+
+            uint32_t fragment_header[2];
+            fragment_header[0] = asio::detail::socket_ops::host_to_network_long(body_len);
+            fragment_header[1] = asio::detail::socket_ops::host_to_network_long(offset);
+
+            auto header = make_header(cmd, seq, flags, fragment_header_length + payload_len);
+            if (body_owner)
+            {
+                packets.push_back(std::allocate_shared<packet_t>(packet_pool_allocator_t<packet_t>(), cmd, seq, header, (const uint8_t*)fragment_header, fragment_header_length, body_owner, body_buf + offset, payload_len));
+            }
+            else
+            {
+                packets.push_back(std::allocate_shared<packet_t>(packet_pool_allocator_t<packet_t>(), cmd, seq, header, (const uint8_t*)fragment_header, fragment_header_length, body_buf + offset, payload_len));
+            }
+        }
+    }
+
+    bool packet_t::should_compress(const build_opt_t& opt, uint32_t body_len)
+    {
+        return (opt.codec != nullptr) && (body_len >= opt.compress_min_length) && (body_len > compression_header_length);
+    }
+
+    std::shared_ptr<packet_t> packet_t::build_compressed_packet(uint32_t cmd, uint32_t seq, uint8_t flags, const uint8_t* body_buf, uint32_t body_len, const codec_t& codec)
+    {
+        //anything that does not end up smaller than the raw body is not worth the receiver's time
+        static thread_local std::vector<uint8_t> scratch;
+        uint32_t max_len = body_len - compression_header_length - 1;
+        if (scratch.size() < max_len)
+        {
+            scratch.resize(max_len);
+        }
+        uint32_t compressed_len = codec.compress(body_buf, body_len, scratch.data(), max_len);
+        if (compressed_len == 0)
+        {
+            return nullptr;
+        }
+
+        uint8_t compression_header[compression_header_length];
+        compression_header[0] = codec.id();
+        uint32_t raw_len = asio::detail::socket_ops::host_to_network_long(body_len);
+        memcpy(compression_header + 1, &raw_len, sizeof(raw_len));
+
+        auto header = make_header(cmd, seq, flags | flag_compressed, compression_header_length + compressed_len);
+        return std::allocate_shared<packet_t>(packet_pool_allocator_t<packet_t>(), cmd, seq, header, compression_header, compression_header_length, scratch.data(), compressed_len);
+    }
+
+    std::shared_ptr<packet_t> packet_t::allocate_packet(uint32_t cmd, uint32_t seq, bool is_push, uint32_t body_len)
+    {
+        auto header = make_header(cmd, seq, is_push ? flag_push : 0, body_len);
+        return std::allocate_shared<packet_t>(packet_pool_allocator_t<packet_t>(), cmd, seq, header, nullptr, 0, nullptr, body_len);
+    }
+
+    std::shared_ptr<packet_t> packet_t::prepare_packet(uint32_t cmd, uint32_t seq, bool is_push, uint32_t body_len, const build_opt_t* opt)
+    {
+        if (opt == nullptr)
+        {
+            opt = &default_build_opt;
+        }
+
+        if ((body_len > max_body_length) || should_compress(*opt, body_len))
+        {
+            return nullptr;
+        }
+
+        uint8_t flags = (is_push ? flag_push : 0) | (opt->body_checksum ? flag_body_crc32c : 0);
+        auto header = make_header(cmd, seq, flags, body_len);
+        return std::allocate_shared<packet_t>(packet_pool_allocator_t<packet_t>(), cmd, seq, header, nullptr, 0, nullptr, body_len);
+    }
+
+    void packet_t::seal_body()
+    {
+        if (((flags_ & flag_body_crc32c) == 0) || !has_contiguous_body())
+        {
+            return;
+        }
+
+        uint32_t body_crc = asio::detail::socket_ops::host_to_network_long(crc32c::value(body(), body_length_));
+        memcpy(data_ + header_length + body_length_, &body_crc, body_crc_length);
+    }
+
+    packet_t::packet_header_t packet_t::make_header(uint32_t cmd, uint32_t seq, uint8_t flags, uint32_t body_len)
+    {
         packet_header_t header;
         header.flag = packet_begin_flag;
         header.cmd = asio::detail::socket_ops::host_to_network_long(cmd);
         header.seq = asio::detail::socket_ops::host_to_network_long(seq);
-        header.is_push = is_push?1:0;
+        header.flags = flags;
         header.body_len = asio::detail::socket_ops::host_to_network_long(body_len);
         header.crc = calc_crc8((const uint8_t*)&header, header_length - 1);
-        
-        return std::make_shared<packet_t>(cmd, seq, is_push, header, body_buf, body_len);
+        return header;
     }
 
     std::shared_ptr<packet_t> packet_t::parse_packet(uint8_t* buf, uint32_t buf_len, uint32_t& consume_len)
+    {
+        packet_view_t view;
+        if (!parse_packet_view(buf, buf_len, consume_len, view))
+        {
+            return nullptr;
+        }
+
+        return view.copy();
+    }
+
+    bool packet_t::parse_packet_view(const uint8_t* buf, uint32_t buf_len, uint32_t& consume_len, packet_view_t& view)
     {
         consume_len = 0;
         do {
-            for (; consume_len < buf_len; ++consume_len)
+            header_info_t header;
+            if (!find_header(buf, buf_len, consume_len, header))
             {
-                if (buf[consume_len] == packet_begin_flag)
-                {
-                    break;
-                }
+                return false;
             }
-            
-            uint8_t* buf_valid = buf + consume_len;
+
+            const uint8_t* buf_valid = buf + consume_len;
             uint32_t buf_valid_len = buf_len - consume_len;
-            
-            if (buf_valid_len < header_length)
+            uint32_t body_len = header.body_len;
+            uint32_t frame_len = header.header_len + body_len + trailer_length(header.flags);
+
+            if (buf_valid_len < frame_len)
             {
-                return nullptr;
+                return false;
             }
-            
-            packet_header_t* header = (packet_header_t*)buf_valid;
-            auto crc = calc_crc8(buf_valid, header_length - 1);
-            if (crc != header->crc)
+            consume_len += frame_len;
+
+            if (((header.flags & flag_fragment) != 0) && (body_len < fragment_header_length))
             {
-                ++consume_len;
                 continue;
             }
-            
-            uint32_t body_len = asio::detail::socket_ops::network_to_host_long(header->body_len);
-            
-            if (body_len > max_body_length)
+
+            if (((header.flags & flag_compressed) != 0) && (((header.flags & flag_fragment) != 0) || (body_len < compression_header_length)))
             {
-                consume_len += header_length;
                 continue;
             }
-            
-            if (buf_valid_len < header_length + body_len)
+
+            const uint8_t* body = buf_valid + header.header_len;
+            if ((header.flags & flag_body_crc32c) != 0)
             {
-                return nullptr;
+                uint32_t body_crc = 0;
+                memcpy(&body_crc, body + body_len, body_crc_length);
+                if (crc32c::value(body, body_len) != asio::detail::socket_ops::network_to_host_long(body_crc))
+                {
+                    //corrupted body, drop the whole frame
+                    continue;
+                }
             }
-            consume_len += header_length + body_len;
 
-            uint32_t cmd = asio::detail::socket_ops::network_to_host_long(header->cmd);
-            uint32_t seq = asio::detail::socket_ops::network_to_host_long(header->seq);
-            bool is_push = (header->is_push == 1)?true:false;
-            return std::make_shared<packet_t>(cmd, seq, is_push, *header, buf_valid + header_length, body_len);
+            view.data_ = buf_valid;
+            view.body_ = body;
+            view.cmd_ = header.cmd;
+            view.seq_ = header.seq;
+            view.flags_ = header.flags;
+            view.body_length_ = body_len;
+            view.chunk_ = nullptr;
+            view.owner_.reset();
+            return true;
         } while (1);
-        
-        return nullptr;
+
+        return false;
+    }
+
+    bool packet_t::find_header(const uint8_t* buf, uint32_t buf_len, uint32_t& pos, header_info_t& info)
+    {
+        //fast path, a clean stream has the next header right at pos
+        if ((pos < buf_len) && ((buf[pos] & begin_flag_mask) == compact_begin_flag))
+        {
+            auto check = decode_header(buf + pos, buf_len - pos, info);
+            if (check == header_incomplete)
+            {
+                return false;
+            }
+
+            if ((check == header_valid) && (calc_crc8(buf + pos, info.header_len - 1) == buf[pos + info.header_len - 1]))
+            {
+                return true;
+            }
+            ++pos;
+        }
+
+        //resync, gather a batch of plausible candidates with the vector scan and check their crc in one pass
+        constexpr uint32_t batch_size = 4;
+        do {
+            uint32_t candidates[batch_size];
+            uint32_t crc_lengths[batch_size];
+            header_info_t infos[batch_size];
+            uint32_t count = 0;
+            uint32_t scan = pos;
+            while (count < batch_size)
+            {
+                scan = find_begin_flag(buf, scan, buf_len);
+                if (scan >= buf_len)
+                {
+                    break;
+                }
+
+                auto check = decode_header(buf + scan, buf_len - scan, infos[count]);
+                if (check == header_incomplete)
+                {
+                    break;
+                }
+
+                if (check == header_valid)
+                {
+                    crc_lengths[count] = infos[count].header_len - 1;
+                    candidates[count++] = scan;
+                }
+                ++scan;
+            }
+
+            uint8_t crcs[batch_size];
+            calc_header_crc8_batch(buf, candidates, crc_lengths, count, crcs);
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                if (crcs[i] == buf[candidates[i] + crc_lengths[i]])
+                {
+                    pos = candidates[i];
+                    info = infos[i];
+                    return true;
+                }
+            }
+
+            if (count < batch_size)
+            {
+                //scan stopped at a flag without a complete header behind it, or at the end of buf
+                pos = scan;
+                return false;
+            }
+            pos = candidates[count - 1] + 1;
+        } while (1);
+
+        return false;
+    }
+
+    uint32_t packet_t::find_begin_flag(const uint8_t* buf, uint32_t pos, uint32_t buf_len)
+    {
+        //the two begin flags only differ in the lowest bit, mask it off and look for the compact one
+#if defined(IBASE_PACKET_AVX2)
+        const __m256i flag_x32 = _mm256_set1_epi8((char)compact_begin_flag);
+        const __m256i mask_x32 = _mm256_set1_epi8((char)begin_flag_mask);
+        for (; pos + 32 <= buf_len; pos += 32)
+        {
+            __m256i block = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(buf + pos)), mask_x32);
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, flag_x32));
+            if (mask != 0)
+            {
+                return pos + count_trailing_zeros(mask);
+            }
+        }
+#endif
+#if defined(IBASE_PACKET_SSE2)
+        const __m128i flag_x16 = _mm_set1_epi8((char)compact_begin_flag);
+        const __m128i mask_x16 = _mm_set1_epi8((char)begin_flag_mask);
+        for (; pos + 16 <= buf_len; pos += 16)
+        {
+            __m128i block = _mm_and_si128(_mm_loadu_si128((const __m128i*)(buf + pos)), mask_x16);
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, flag_x16));
+            if (mask != 0)
+            {
+                return pos + count_trailing_zeros(mask);
+            }
+        }
+#endif
+        for (; pos < buf_len; ++pos)
+        {
+            if ((buf[pos] & begin_flag_mask) == compact_begin_flag)
+            {
+                break;
+            }
+        }
+        return pos;
+    }
+
+    packet_t::header_check_t packet_t::decode_header(const uint8_t* buf, uint32_t buf_len, header_info_t& info)
+    {
+        //cheap field checks that throw away almost every false flag before any crc work
+        if (buf[0] == packet_begin_flag)
+        {
+            if (buf_len < header_length)
+            {
+                return header_incomplete;
+            }
+
+            const packet_header_t* header = (const packet_header_t*)buf;
+            info.cmd = asio::detail::socket_ops::network_to_host_long(header->cmd);
+            info.seq = asio::detail::socket_ops::network_to_host_long(header->seq);
+            info.flags = header->flags;
+            info.body_len = asio::detail::socket_ops::network_to_host_long(header->body_len);
+            info.header_len = header_length;
+        }
+        else
+        {
+            if (buf_len < 2)
+            {
+                return header_incomplete;
+            }
+
+            info.flags = buf[1];
+            uint32_t pos = 2;
+            auto check = read_varint(buf, buf_len, pos, info.cmd);
+            if (check == header_valid)
+            {
+                check = read_varint(buf, buf_len, pos, info.seq);
+            }
+            if (check == header_valid)
+            {
+                check = read_varint(buf, buf_len, pos, info.body_len);
+            }
+            if (check != header_valid)
+            {
+                return check;
+            }
+
+            if (pos >= buf_len)
+            {
+                return header_incomplete;
+            }
+            info.header_len = pos + 1;
+        }
+
+        if (((info.flags & ~known_flags) != 0) || (info.body_len > max_body_length))
+        {
+            return header_implausible;
+        }
+        return header_valid;
+    }
+
+    packet_t::header_check_t packet_t::read_varint(const uint8_t* buf, uint32_t buf_len, uint32_t& pos, uint32_t& value)
+    {
+        value = 0;
+        for (uint32_t i = 0; i < max_varint_length; ++i)
+        {
+            if (pos >= buf_len)
+            {
+                return header_incomplete;
+            }
+
+            uint8_t b = buf[pos++];
+            value |= (uint32_t)(b & 0x7f) << (7*i);
+            if ((b & 0x80) == 0)
+            {
+                //the fifth byte may only carry the top 4 bits
+                return ((i == max_varint_length - 1) && (b > 0x0f)) ? header_implausible : header_valid;
+            }
+        }
+        return header_implausible;
+    }
+
+    uint32_t packet_t::write_varint(uint8_t* buf, uint32_t value)
+    {
+        uint32_t len = 0;
+        while (value >= 0x80)
+        {
+            buf[len++] = (uint8_t)(value | 0x80);
+            value >>= 7;
+        }
+        buf[len++] = (uint8_t)value;
+        return len;
+    }
+
+    uint32_t packet_t::write_compact_header(uint8_t* buf) const
+    {
+        uint32_t len = 0;
+        buf[len++] = compact_begin_flag;
+        buf[len++] = flags_;
+        len += write_varint(buf + len, cmd_);
+        len += write_varint(buf + len, seq_);
+        len += write_varint(buf + len, body_length_);
+        buf[len] = calc_crc8(buf, len);
+        return len + 1;
     }
         
-    packet_t::packet_t(uint32_t cmd, uint32_t seq, bool is_push, packet_header_t& header, uint8_t* body_buf, uint32_t body_len)
+    packet_t::packet_t(uint32_t cmd, uint32_t seq, packet_header_t& header, uint8_t* body_buf, uint32_t body_len)
+        : packet_t(cmd, seq, header, nullptr, 0, body_buf, body_len)
+    {
+    }
+
+    packet_t::packet_t(uint32_t cmd, uint32_t seq, const packet_header_t& header, const uint8_t* prefix, uint32_t prefix_len, const uint8_t* body_buf, uint32_t body_len)
         : cmd_(cmd)
         , seq_(seq)
-        , is_push_(is_push?1:0)
-        , body_length_(body_len)
+        , flags_(header.flags)
+        , body_length_(prefix_len + body_len)
     {
+        data_ = packet_pool_t::allocate(length());
         memcpy(data_, &header, header_length);
+
+        uint8_t* body_pos = data_ + header_length;
+        if ((flags_ & flag_body_crc32c) != 0)
+        {
+            //checksum while copying, the body is only touched once
+            uint32_t body_crc = 0;
+            if (prefix_len > 0)
+            {
+                body_crc = crc32c::copy_and_extend(body_crc, body_pos, prefix, prefix_len);
+            }
+            //a body left for the caller to write is checksummed by seal_body() once written
+            if (body_buf != nullptr)
+            {
+                body_crc = crc32c::copy_and_extend(body_crc, body_pos + prefix_len, body_buf, body_len);
+            }
+            body_crc = asio::detail::socket_ops::host_to_network_long(body_crc);
+            memcpy(body_pos + body_length_, &body_crc, body_crc_length);
+            return;
+        }
+
+        if (prefix_len > 0)
+        {
+            memcpy(body_pos, prefix, prefix_len);
+        }
         if ((body_buf != nullptr) && (body_len > 0))
         {
-            memcpy(data_ + header_length, body_buf, body_len);
+            memcpy(body_pos + prefix_len, body_buf, body_len);
+        }
+    }
+
+    packet_t::packet_t(uint32_t cmd, uint32_t seq, const packet_header_t& header, const uint8_t* prefix, uint32_t prefix_len, std::shared_ptr<ibuffer> body_owner, const uint8_t* body_buf, uint32_t body_len)
+        : cmd_(cmd)
+        , seq_(seq)
+        , flags_(header.flags)
+        , body_length_(prefix_len + body_len)
+        , body_owner_(std::move(body_owner))
+        , external_body_(body_buf)
+        , external_length_(body_len)
+    {
+        data_ = packet_pool_t::allocate(storage_length());
+        memcpy(data_, &header, header_length);
+        if (prefix_len > 0)
+        {
+            memcpy(data_ + header_length, prefix, prefix_len);
+        }
+
+        if ((flags_ & flag_body_crc32c) != 0)
+        {
+            //the body is read once for the checksum, never copied
+            uint32_t body_crc = crc32c::extend(0, data_ + header_length, prefix_len);
+            body_crc = crc32c::extend(body_crc, external_body_, external_length_);
+            body_crc = asio::detail::socket_ops::host_to_network_long(body_crc);
+            memcpy(data_ + header_length + prefix_len, &body_crc, body_crc_length);
         }
     }
 
+    packet_t::~packet_t()
+    {
+        packet_pool_t::release(data_, storage_length());
+    }
+
     uint32_t packet_t::cmd()
     {
         return cmd_;
@@ -117,17 +624,31 @@ namespace ibase
 
     bool packet_t::is_push()
     {
-        return is_push_ != 0;
+        return (flags_ & flag_push) != 0;
+    }
+
+    bool packet_t::has_body_checksum() const
+    {
+        return (flags_ & flag_body_crc32c) != 0;
+    }
+
+    bool packet_t::is_compressed() const
+    {
+        return (flags_ & flag_compressed) != 0;
     }
 
     const uint8_t* packet_t::body() const
     {
-        return data_ + header_length;
+        return const_cast<packet_t*>(this)->body();
     }
 
     uint8_t* packet_t::body()
     {
-        return data_ + header_length;
+        if (external_body_ == nullptr)
+        {
+            return data_ + header_length;
+        }
+        return has_contiguous_body() ? const_cast<uint8_t*>(external_body_) : nullptr;
     }
 
     uint32_t packet_t::body_length() const
@@ -146,7 +667,56 @@ namespace ibase
 
     uint32_t packet_t::length() const
     {
-        return header_length + body_length_;
+        return header_length + body_length_ + trailer_length(flags_);
+    }
+
+    bool packet_t::has_contiguous_body() const
+    {
+        return (external_body_ == nullptr) || (external_length_ == body_length_);
+    }
+
+    uint32_t packet_t::segments(segment_t (&out)[max_segments], header_format_t format, uint8_t* compact_header) const
+    {
+        //the classic header is stored in front of the body, the compact one replaces it as a separate piece.
+        //it is only encoded for connections that use it, most packets never need one
+        uint32_t count = 0;
+        const uint8_t* rest = data_;
+        if (format == header_format_t::compact)
+        {
+            out[count++] = {compact_header, write_compact_header(compact_header)};
+            rest += header_length;
+        }
+
+        if (external_body_ == nullptr)
+        {
+            out[count++] = {rest, (uint32_t)(data_ + length() - rest)};
+            return count;
+        }
+
+        uint32_t head_length = header_length + body_length_ - external_length_;
+        if (data_ + head_length > rest)
+        {
+            out[count++] = {rest, (uint32_t)(data_ + head_length - rest)};
+        }
+        if (external_length_ > 0)
+        {
+            out[count++] = {external_body_, external_length_};
+        }
+        if (trailer_length(flags_) > 0)
+        {
+            out[count++] = {data_ + head_length, trailer_length(flags_)};
+        }
+        return count;
+    }
+
+    uint32_t packet_t::storage_length() const
+    {
+        return length() - external_length_;
+    }
+
+    uint32_t packet_t::trailer_length(uint8_t flags)
+    {
+        return ((flags & flag_body_crc32c) != 0) ? body_crc_length : 0;
     }
 
     uint8_t packet_t::calc_crc8(const uint8_t* data, uint32_t len)
@@ -159,4 +729,207 @@ namespace ibase
         }
         return val;
     }
+
+    void packet_t::calc_header_crc8_batch(const uint8_t* buf, const uint32_t* offsets, const uint32_t* lengths, uint32_t count, uint8_t* crcs)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        uint32_t common_length = lengths[0];
+        for (uint32_t i = 1; i < count; ++i)
+        {
+            common_length = std::min(common_length, lengths[i]);
+        }
+
+        //four independent table chains, so the lookups of different candidates overlap
+        const uint8_t* data0 = buf + offsets[0];
+        const uint8_t* data1 = (count > 1) ? buf + offsets[1] : data0;
+        const uint8_t* data2 = (count > 2) ? buf + offsets[2] : data0;
+        const uint8_t* data3 = (count > 3) ? buf + offsets[3] : data0;
+        uint8_t val0 = 0x77, val1 = 0x77, val2 = 0x77, val3 = 0x77;
+        for (uint32_t i = 0; i < common_length; ++i)
+        {
+            val0 = crc8_table[val0 ^ data0[i]];
+            val1 = crc8_table[val1 ^ data1[i]];
+            val2 = crc8_table[val2 ^ data2[i]];
+            val3 = crc8_table[val3 ^ data3[i]];
+        }
+
+        //compact headers differ in length, finish the longer ones one by one
+        const uint8_t vals[4] = {val0, val1, val2, val3};
+        for (uint32_t i = 0; i < count && i < 4; ++i)
+        {
+            uint8_t val = vals[i];
+            const uint8_t* data = buf + offsets[i];
+            for (uint32_t k = common_length; k < lengths[i]; ++k)
+            {
+                val = crc8_table[val ^ data[k]];
+            }
+            crcs[i] = val;
+        }
+    }
+
+    packet_view_t packet_view_t::from_packet(std::shared_ptr<packet_t> packet)
+    {
+        packet_view_t view;
+        if (!packet)
+        {
+            return view;
+        }
+
+        view.data_ = packet->external_body_ == nullptr ? packet->data() : nullptr;
+        view.body_ = packet->body();
+        view.cmd_ = packet->cmd();
+        view.seq_ = packet->seq();
+        view.flags_ = packet->flags_;
+        view.body_length_ = packet->body_length();
+        if (view.body_ == nullptr)
+        {
+            view.flags_ &= packet_t::flag_push;
+            view.body_length_ = 0;
+        }
+        view.owner_ = std::move(packet);
+        return view;
+    }
+
+    uint32_t packet_view_t::cmd() const
+    {
+        return cmd_;
+    }
+
+    uint32_t packet_view_t::seq() const
+    {
+        return seq_;
+    }
+
+    bool packet_view_t::is_push() const
+    {
+        return (flags_ & packet_t::flag_push) != 0;
+    }
+
+    bool packet_view_t::has_body_checksum() const
+    {
+        return (flags_ & packet_t::flag_body_crc32c) != 0;
+    }
+
+    bool packet_view_t::is_compressed() const
+    {
+        return (flags_ & packet_t::flag_compressed) != 0;
+    }
+
+    const uint8_t* packet_view_t::body() const
+    {
+        return body_;
+    }
+
+    uint32_t packet_view_t::body_length() const
+    {
+        return body_length_;
+    }
+
+    const uint8_t* packet_view_t::data() const
+    {
+        return data_;
+    }
+
+    uint32_t packet_view_t::length() const
+    {
+        if (data_ == nullptr)
+        {
+            return 0;
+        }
+        return (uint32_t)(body_ - data_) + body_length_ + packet_t::trailer_length(flags_);
+    }
+
+    packet_view_t packet_view_t::decompress() const
+    {
+        if (!is_compressed())
+        {
+            return *this;
+        }
+
+        auto codec = codec::find_codec(body()[0]);
+        uint32_t raw_len = 0;
+        memcpy(&raw_len, body() + 1, sizeof(raw_len));
+        raw_len = asio::detail::socket_ops::network_to_host_long(raw_len);
+        if ((codec == nullptr) || (raw_len > packet_t::max_body_length))
+        {
+            return packet_view_t();
+        }
+
+        auto packet = packet_t::allocate_packet(cmd_, seq_, is_push(), raw_len);
+        if (!codec->decompress(body() + packet_t::compression_header_length, body_length_ - packet_t::compression_header_length, packet->body(), raw_len))
+        {
+            return packet_view_t();
+        }
+        return from_packet(std::move(packet));
+    }
+
+    bool packet_view_t::is_fragment() const
+    {
+        return (flags_ & packet_t::flag_fragment) != 0;
+    }
+
+    uint32_t packet_view_t::fragment_total_length() const
+    {
+        uint32_t total_length = 0;
+        memcpy(&total_length, body(), sizeof(total_length));
+        return asio::detail::socket_ops::network_to_host_long(total_length);
+    }
+
+    uint32_t packet_view_t::fragment_offset() const
+    {
+        uint32_t offset = 0;
+        memcpy(&offset, body() + sizeof(uint32_t), sizeof(offset));
+        return asio::detail::socket_ops::network_to_host_long(offset);
+    }
+
+    const uint8_t* packet_view_t::fragment_data() const
+    {
+        return body() + packet_t::fragment_header_length;
+    }
+
+    uint32_t packet_view_t::fragment_data_length() const
+    {
+        return body_length_ - packet_t::fragment_header_length;
+    }
+
+    bool packet_view_t::is_last_fragment() const
+    {
+        return fragment_offset() + fragment_data_length() >= fragment_total_length();
+    }
+
+    void packet_view_t::set_chunk(const std::shared_ptr<bev::io_buffer>* chunk)
+    {
+        chunk_ = chunk;
+    }
+
+    std::shared_ptr<packet_t> packet_view_t::copy() const
+    {
+        if ((data_ == nullptr) && !owner_)
+        {
+            return nullptr;
+        }
+
+        auto header = packet_t::make_header(cmd_, seq_, flags_, body_length_);
+        return std::allocate_shared<packet_t>(packet_pool_allocator_t<packet_t>(), cmd_, seq_, header, (uint8_t*)body(), body_length_);
+    }
+
+    packet_view_t packet_view_t::retain() const
+    {
+        packet_view_t view(*this);
+        if (!view.owner_ && (chunk_ != nullptr))
+        {
+            view.owner_ = *chunk_;
+        }
+        view.chunk_ = nullptr;
+        return view;
+    }
+
+    bool packet_view_t::retained() const
+    {
+        return owner_ != nullptr;
+    }
 }
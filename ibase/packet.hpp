@@ -1,53 +1,232 @@
 #pragma once
 #include <memory>
+#include <vector>
+
+namespace bev
+{
+    class io_buffer;
+}
 
 namespace ibase
 {
+    class packet_t;
+    class codec_t;
+    class ibuffer;
+
+    //a received packet that points straight into the connection's read chunk. only valid inside the
+    //receive callback, unless it is copied out with copy() or the chunk is kept alive with retain()
+    class packet_view_t
+    {
+        friend class packet_t;
+    public:
+        packet_view_t() = default;
+
+        //a packet whose body is split between itself and an ibuffer (a fragment sent without copying)
+        //gives a view with cmd and seq only
+        static packet_view_t from_packet(std::shared_ptr<packet_t> packet);
+
+        uint32_t cmd() const;
+        uint32_t seq() const;
+        bool is_push() const;
+        bool has_body_checksum() const;
+        bool is_compressed() const;
+        const uint8_t* body() const;
+        uint32_t body_length() const;
+        //the whole frame, nullptr for a packet built on an ibuffer
+        const uint8_t* data() const;
+        uint32_t length() const;
+
+        //the packet with its body decompressed into a packet_t, the view itself if it is not compressed.
+        //an empty view (data() == nullptr) if the codec is not registered or the body does not decode
+        packet_view_t decompress() const;
+
+        //a fragment of a message larger than one packet, its body starts with the fragment header
+        bool is_fragment() const;
+        uint32_t fragment_total_length() const;
+        uint32_t fragment_offset() const;
+        const uint8_t* fragment_data() const;
+        uint32_t fragment_data_length() const;
+        bool is_last_fragment() const;
+
+        //the chunk the view points into, set by the connection that parsed it
+        void set_chunk(const std::shared_ptr<bev::io_buffer>* chunk);
+        //copy the frame into its own packet_t
+        std::shared_ptr<packet_t> copy() const;
+        //keep the read chunk alive, the returned view stays valid after the callback. the connection
+        //notices the extra reference and continues reading into a fresh chunk
+        packet_view_t retain() const;
+        bool retained() const;
+    private:
+        const uint8_t*                              data_{nullptr};
+        const uint8_t*                              body_{nullptr};
+        uint32_t                                    cmd_{0};
+        uint32_t                                    seq_{0};
+        uint8_t                                     flags_{0};
+        uint32_t                                    body_length_{0};
+        const std::shared_ptr<bev::io_buffer>*      chunk_{nullptr};
+        std::shared_ptr<const void>                 owner_;
+    };
+
     class packet_t
     {
+        friend class packet_view_t;
+
         #pragma pack(1)
         struct packet_header_t
         {
             uint8_t         flag;
             uint32_t        cmd;
             uint32_t        seq;
-            uint8_t         is_push;
+            uint8_t         flags;
             uint32_t        body_len;
             uint8_t         crc;
         };
         #pragma pack()
+
+        //a parsed header of either format
+        struct header_info_t
+        {
+            uint32_t        cmd;
+            uint32_t        seq;
+            uint8_t         flags;
+            uint32_t        body_len;
+            uint32_t        header_len;
+        };
+
+        enum header_check_t
+        {
+            header_valid,
+            header_incomplete,
+            header_implausible,
+        };
         
         constexpr static uint8_t packet_begin_flag = 0x55;
         constexpr static uint32_t header_length = sizeof(packet_header_t);
+        //compact header: flag, flags, varint cmd, varint seq, varint body_len, crc8 of the bytes before it
+        constexpr static uint8_t compact_begin_flag = 0x54;
+        constexpr static uint8_t begin_flag_mask = 0xfe;            //both begin flags in one compare
+        constexpr static uint32_t max_varint_length = 5;
+
+        //bits of packet_header_t::flags
+        constexpr static uint8_t flag_push = 0x01;
+        constexpr static uint8_t flag_body_crc32c = 0x02;           //a crc32c of the body follows the body
+        constexpr static uint8_t flag_fragment = 0x04;              //body starts with total length and offset of the message
+        constexpr static uint8_t flag_compressed = 0x08;            //body starts with codec id and raw length, never set on fragments
+        constexpr static uint8_t known_flags = flag_push | flag_body_crc32c | flag_fragment | flag_compressed;
+        constexpr static uint32_t body_crc_length = sizeof(uint32_t);
+        constexpr static uint32_t fragment_header_length = 2*sizeof(uint32_t);
+        constexpr static uint32_t compression_header_length = sizeof(uint8_t) + sizeof(uint32_t);
+    public:
         constexpr static uint32_t max_packet_length = 16*1024;
         constexpr static uint32_t max_body_length = max_packet_length - header_length;
-    public:
-        static std::shared_ptr<packet_t> build_packet(uint32_t cmd, uint32_t seq, bool is_push, uint8_t* body_buf, uint32_t body_len);
+        constexpr static uint32_t max_fragment_payload_length = max_body_length - fragment_header_length;
+        constexpr static uint32_t max_message_length = 64*1024*1024;
+        constexpr static uint32_t default_compress_min_length = 256;
+
+        //wire format of the header, both are always accepted by parse_packet. compact is only sent once
+        //the peer announced it understands it
+        enum class header_format_t
+        {
+            classic,
+            compact,
+        };
+
+        struct build_opt_t
+        {
+            bool body_checksum{false};
+            //bodies of at least compress_min_length bytes go through codec, kept only if that saves bytes.
+            //fragments of larger messages are sent as they are
+            const codec_t* codec{nullptr};
+            uint32_t compress_min_length{default_compress_min_length};
+        };
+
+        static build_opt_t default_build_opt;
+
+        //a piece of the frame as it goes on the wire
+        struct segment_t
+        {
+            const uint8_t*  data;
+            uint32_t        length;
+        };
+        constexpr static uint32_t max_segments = 4;
+        //room for the compact header segments() encodes
+        constexpr static uint32_t max_compact_header_length = 3 + 3*max_varint_length;
+
+        static std::shared_ptr<packet_t> build_packet(uint32_t cmd, uint32_t seq, bool is_push, uint8_t* body_buf, uint32_t body_len, const build_opt_t* opt = nullptr);
+        //one packet when the body fits, otherwise the fragments of the message. empty above max_message_length
+        static std::vector<std::shared_ptr<packet_t>> build_packets(uint32_t cmd, uint32_t seq, bool is_push, uint8_t* body_buf, uint32_t body_len, const build_opt_t* opt = nullptr);
+        //the packet points into body instead of copying it, only a body that gets compressed is copied.
+        //nullptr above max_body_length
+        static std::shared_ptr<packet_t> build_packet(uint32_t cmd, uint32_t seq, bool is_push, std::shared_ptr<ibuffer> body, const build_opt_t* opt = nullptr);
+        //same, but the packets point into body instead of copying it, fragments of a large body share it.
+        //only a body that gets compressed is copied
+        static std::vector<std::shared_ptr<packet_t>> build_packets(uint32_t cmd, uint32_t seq, bool is_push, std::shared_ptr<ibuffer> body, const build_opt_t* opt = nullptr);
+        //packet with an unfilled body of any length for the caller to write, used for reassembled messages
+        static std::shared_ptr<packet_t> allocate_packet(uint32_t cmd, uint32_t seq, bool is_push, uint32_t body_len);
+        //packet with an unfilled body for encoding a message in place, call seal_body() once it is written.
+        //nullptr when the body needs more than one packet or would be compressed, build those from an ibuffer
+        static std::shared_ptr<packet_t> prepare_packet(uint32_t cmd, uint32_t seq, bool is_push, uint32_t body_len, const build_opt_t* opt = nullptr);
         static std::shared_ptr<packet_t> parse_packet(uint8_t* buf, uint32_t buf_len, uint32_t& consume_len);
+        //same framing as parse_packet, but fills a view into buf instead of copying the frame
+        static bool parse_packet_view(const uint8_t* buf, uint32_t buf_len, uint32_t& consume_len, packet_view_t& view);
         
-        packet_t(uint32_t cmd, uint32_t seq, bool is_push, packet_header_t& header, uint8_t* body_buf, uint32_t body_len);
+        packet_t(uint32_t cmd, uint32_t seq, packet_header_t& header, uint8_t* body_buf, uint32_t body_len);
+        packet_t(uint32_t cmd, uint32_t seq, const packet_header_t& header, const uint8_t* prefix, uint32_t prefix_len, const uint8_t* body_buf, uint32_t body_len);
+        packet_t(uint32_t cmd, uint32_t seq, const packet_header_t& header, const uint8_t* prefix, uint32_t prefix_len, std::shared_ptr<ibuffer> body_owner, const uint8_t* body_buf, uint32_t body_len);
+        ~packet_t();
 
         uint32_t cmd();
         uint32_t seq();
         bool is_push();
+        bool has_body_checksum() const;
+        bool is_compressed() const;
+        //nullptr if has_contiguous_body() is false
         const uint8_t* body() const;
         uint8_t* body();
         uint32_t body_length() const;
+        //the whole frame only if the body is not kept in an ibuffer, write packets with segments()
         const uint8_t* data() const;
         uint8_t* data();
         uint32_t length() const;
+        bool has_contiguous_body() const;
+        //the frame as header, body and trailer pieces, returns how many of out were filled. the compact header
+        //is encoded into compact_header, max_compact_header_length bytes that have to outlive the write
+        uint32_t segments(segment_t (&out)[max_segments], header_format_t format = header_format_t::classic, uint8_t* compact_header = nullptr) const;
+        //fills in the body checksum of a packet from prepare_packet after the body was written
+        void seal_body();
     private:
         packet_t(const packet_t& other) = delete;
         packet_t(packet_t&& other) = delete;
         packet_t& operator=(const packet_t& other) = delete;
         packet_t& operator=(packet_t&& other) = delete;
     private:
+        static packet_header_t make_header(uint32_t cmd, uint32_t seq, uint8_t flags, uint32_t body_len);
+        static std::shared_ptr<packet_t> build_compressed_packet(uint32_t cmd, uint32_t seq, uint8_t flags, const uint8_t* body_buf, uint32_t body_len, const codec_t& codec);
+        static bool should_compress(const build_opt_t& opt, uint32_t body_len);
+        static void build_fragments(uint32_t cmd, uint32_t seq, uint8_t flags, const std::shared_ptr<ibuffer>& body_owner, const uint8_t* body_buf, uint32_t body_len, std::vector<std::shared_ptr<packet_t>>& packets);
         static uint8_t calc_crc8(const uint8_t* data, uint32_t len);
+        static void calc_header_crc8_batch(const uint8_t* buf, const uint32_t* offsets, const uint32_t* lengths, uint32_t count, uint8_t* crcs);
+        static bool find_header(const uint8_t* buf, uint32_t buf_len, uint32_t& pos, header_info_t& info);
+        static uint32_t find_begin_flag(const uint8_t* buf, uint32_t pos, uint32_t buf_len);
+        static header_check_t decode_header(const uint8_t* buf, uint32_t buf_len, header_info_t& info);
+        static header_check_t read_varint(const uint8_t* buf, uint32_t buf_len, uint32_t& pos, uint32_t& value);
+        static uint32_t write_varint(uint8_t* buf, uint32_t value);
+        uint32_t write_compact_header(uint8_t* buf) const;
+        static uint32_t trailer_length(uint8_t flags);
+        uint32_t storage_length() const;
       private:
-        uint8_t         data_[max_packet_length] = {0};
-        uint32_t        cmd_{0};
-        uint32_t        seq_{0};
-        uint8_t         is_push_{0};
-        uint32_t        body_length_{0};
+        //header + body + optional body crc, sized to the real length and taken from packet_pool_t.
+        //with an external body only the header, the part of the body before it and the crc are stored here
+        uint8_t*                    data_{nullptr};
+        uint32_t                    cmd_{0};
+        uint32_t                    seq_{0};
+        uint8_t                     flags_{0};
+        uint32_t                    body_length_{0};
+        std::shared_ptr<ibuffer>    body_owner_;
+        const uint8_t*              external_body_{nullptr};
+        uint32_t                    external_length_{0};
     };
+
+    //the packets of one encoded message, shared as they are by every session it goes out to
+    using shared_packets_t = std::shared_ptr<const std::vector<std::shared_ptr<packet_t>>>;
 }
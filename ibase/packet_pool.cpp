@@ -0,0 +1,138 @@
+#include "packet_pool.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace ibase
+{
+    namespace
+    {
+        struct free_block_t
+        {
+            free_block_t* next_;
+        };
+
+        struct free_list_t
+        {
+            free_block_t* head_{nullptr};
+            uint32_t count_{0};
+        };
+
+        //set once the thread's pool is destroyed, packets freed later during thread exit bypass it
+        thread_local bool thread_pool_destroyed_ = false;
+
+        struct thread_pool_t
+        {
+            free_list_t lists_[packet_pool_t::size_class_count];
+
+            ~thread_pool_t()
+            {
+                thread_pool_destroyed_ = true;
+                for (auto& list : lists_)
+                {
+                    while (list.head_ != nullptr)
+                    {
+                        auto block = list.head_;
+                        list.head_ = block->next_;
+                        ::free(block);
+                    }
+                    list.count_ = 0;
+                }
+            }
+        };
+
+        thread_local thread_pool_t thread_pool_;
+
+        std::atomic<uint64_t> alloc_count_{0};
+        std::atomic<uint64_t> reuse_count_{0};
+        std::atomic<uint64_t> heap_alloc_count_{0};
+        std::atomic<uint64_t> release_count_{0};
+        std::atomic<uint64_t> heap_free_count_{0};
+        std::atomic<uint64_t> bytes_in_use_{0};
+
+        int size_class_index(uint32_t size)
+        {
+            for (uint32_t i = 0; i < packet_pool_t::size_class_count; ++i)
+            {
+                if (size <= packet_pool_t::size_classes[i])
+                {
+                    return i;
+                }
+            }
+            return -1;
+        }
+    }
+
+    uint8_t* packet_pool_t::allocate(uint32_t size)
+    {
+        alloc_count_.fetch_add(1, std::memory_order_relaxed);
+
+        auto index = size_class_index(size);
+        auto block_size = (index < 0) ? size : size_classes[index];
+        bytes_in_use_.fetch_add(block_size, std::memory_order_relaxed);
+
+        if (index >= 0 && !thread_pool_destroyed_)
+        {
+            auto& list = thread_pool_.lists_[index];
+            if (list.head_ != nullptr)
+            {
+                auto block = list.head_;
+                list.head_ = block->next_;
+                --list.count_;
+                reuse_count_.fetch_add(1, std::memory_order_relaxed);
+                return reinterpret_cast<uint8_t*>(block);
+            }
+        }
+
+        auto block = static_cast<uint8_t*>(::malloc(block_size));
+        if (block == nullptr)
+        {
+            bytes_in_use_.fetch_sub(block_size, std::memory_order_relaxed);
+            throw std::bad_alloc();
+        }
+        heap_alloc_count_.fetch_add(1, std::memory_order_relaxed);
+        return block;
+    }
+
+    void packet_pool_t::release(uint8_t* block, uint32_t size)
+    {
+        if (block == nullptr)
+        {
+            return;
+        }
+
+        release_count_.fetch_add(1, std::memory_order_relaxed);
+
+        auto index = size_class_index(size);
+        auto block_size = (index < 0) ? size : size_classes[index];
+        bytes_in_use_.fetch_sub(block_size, std::memory_order_relaxed);
+
+        if (index >= 0 && !thread_pool_destroyed_)
+        {
+            auto& list = thread_pool_.lists_[index];
+            if (list.count_ < max_free_blocks_per_class)
+            {
+                auto free_block = reinterpret_cast<free_block_t*>(block);
+                free_block->next_ = list.head_;
+                list.head_ = free_block;
+                ++list.count_;
+                return;
+            }
+        }
+
+        heap_free_count_.fetch_add(1, std::memory_order_relaxed);
+        ::free(block);
+    }
+
+    packet_pool_t::stats_t packet_pool_t::stats()
+    {
+        stats_t stats;
+        stats.alloc_count = alloc_count_.load(std::memory_order_relaxed);
+        stats.reuse_count = reuse_count_.load(std::memory_order_relaxed);
+        stats.heap_alloc_count = heap_alloc_count_.load(std::memory_order_relaxed);
+        stats.release_count = release_count_.load(std::memory_order_relaxed);
+        stats.heap_free_count = heap_free_count_.load(std::memory_order_relaxed);
+        stats.bytes_in_use = bytes_in_use_.load(std::memory_order_relaxed);
+        return stats;
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ibase
+{
+    //size-classed block pool for packet storage. every thread keeps its own free lists,
+    //a block released on another thread simply joins that thread's pool.
+    class packet_pool_t
+    {
+    public:
+        struct stats_t
+        {
+            uint64_t alloc_count{0};         //allocate() calls
+            uint64_t reuse_count{0};         //allocations served from a free list
+            uint64_t heap_alloc_count{0};    //allocations that went to the heap
+            uint64_t release_count{0};       //release() calls
+            uint64_t heap_free_count{0};     //releases that went back to the heap
+            uint64_t bytes_in_use{0};        //bytes handed out and not yet released
+        };
+
+        constexpr static uint32_t size_class_count = 5;
+        constexpr static uint32_t size_classes[size_class_count] = {64, 256, 1024, 4*1024, 16*1024};
+        constexpr static uint32_t max_free_blocks_per_class = 1024;
+
+    public:
+        //size is rounded up to its size class, sizes above the largest class come from the heap. never returns
+        //null, throws std::bad_alloc when the heap is out
+        static uint8_t* allocate(uint32_t size);
+        //size must be the value passed to allocate()
+        static void release(uint8_t* block, uint32_t size);
+        static stats_t stats();
+    };
+
+    //lets std::allocate_shared place the packet object and its control block in the pool
+    template<typename T>
+    class packet_pool_allocator_t
+    {
+    public:
+        using value_type = T;
+
+        packet_pool_allocator_t() noexcept = default;
+        template<typename U>
+        packet_pool_allocator_t(const packet_pool_allocator_t<U>&) noexcept {}
+
+        T* allocate(size_t n)
+        {
+            return reinterpret_cast<T*>(packet_pool_t::allocate(static_cast<uint32_t>(n * sizeof(T))));
+        }
+
+        void deallocate(T* p, size_t n) noexcept
+        {
+            packet_pool_t::release(reinterpret_cast<uint8_t*>(p), static_cast<uint32_t>(n * sizeof(T)));
+        }
+
+        template<typename U>
+        bool operator==(const packet_pool_allocator_t<U>&) const noexcept { return true; }
+        template<typename U>
+        bool operator!=(const packet_pool_allocator_t<U>&) const noexcept { return false; }
+    };
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include <stdint.h>
+#include <chrono>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ibase
+{
+    //packets waiting for their ack or response, found by (cmd, seq) and optionally by a caller id in O(1).
+    //every entry has a resend deadline kept in a time ordered set, so a check only visits what is due instead
+    //of everything in flight. not thread safe
+    template<typename info_t>
+    class pending_packet_table_t
+    {
+    public:
+        using time_point_t = std::chrono::steady_clock::time_point;
+        constexpr static uint32_t no_id = 0;
+    private:
+        struct entry_t
+        {
+            info_t info_;
+            uint32_t id_;
+            time_point_t deadline_;
+        };
+
+        using deadline_t = std::pair<time_point_t, uint64_t>;
+    public:
+        static uint64_t make_key(uint32_t cmd, uint32_t seq)
+        {
+            return ((uint64_t)cmd << 32) | seq;
+        }
+
+        uint32_t size() const
+        {
+            return (uint32_t)entries_.size();
+        }
+
+        //an entry already there under the same cmd and seq is replaced
+        info_t& insert(uint32_t cmd, uint32_t seq, uint32_t id, info_t info, time_point_t deadline)
+        {
+            auto key = make_key(cmd, seq);
+            erase(key);
+
+            auto& entry = entries_[key];
+            entry.info_ = std::move(info);
+            entry.id_ = id;
+            entry.deadline_ = deadline;
+            deadlines_.insert({deadline, key});
+            if (id != no_id)
+            {
+                ids_[id] = key;
+            }
+            return entry.info_;
+        }
+
+        info_t* find(uint64_t key)
+        {
+            auto it = entries_.find(key);
+            return (it != entries_.end()) ? &it->second.info_ : nullptr;
+        }
+
+        //moves the entry out, the caller may run callbacks with it while the table is changed underneath
+        bool take(uint64_t key, info_t& info)
+        {
+            auto it = entries_.find(key);
+            if (it == entries_.end())
+            {
+                return false;
+            }
+
+            info = std::move(it->second.info_);
+            remove(it);
+            return true;
+        }
+
+        bool take_by_id(uint32_t id, info_t& info)
+        {
+            auto it = ids_.find(id);
+            return (it != ids_.end()) && take(it->second, info);
+        }
+
+        bool erase(uint64_t key)
+        {
+            auto it = entries_.find(key);
+            if (it == entries_.end())
+            {
+                return false;
+            }
+
+            remove(it);
+            return true;
+        }
+
+        void reschedule(uint64_t key, time_point_t deadline)
+        {
+            auto it = entries_.find(key);
+            if (it == entries_.end())
+            {
+                return;
+            }
+
+            deadlines_.erase({it->second.deadline_, key});
+            it->second.deadline_ = deadline;
+            deadlines_.insert({deadline, key});
+        }
+
+        //keys of everything due at now, the earliest first. collected up front so that handling them may
+        //insert, erase and reschedule freely
+        void collect_due(time_point_t now, std::vector<uint64_t>& keys)
+        {
+            keys.clear();
+            for (auto it = deadlines_.begin(); (it != deadlines_.end()) && (it->first <= now); ++it)
+            {
+                keys.push_back(it->second);
+            }
+        }
+
+        void clear()
+        {
+            entries_.clear();
+            ids_.clear();
+            deadlines_.clear();
+        }
+    private:
+        void remove(typename std::unordered_map<uint64_t, entry_t>::iterator it)
+        {
+            deadlines_.erase({it->second.deadline_, it->first});
+            if (it->second.id_ != no_id)
+            {
+                ids_.erase(it->second.id_);
+            }
+            entries_.erase(it);
+        }
+    private:
+        std::unordered_map<uint64_t, entry_t>   entries_;
+        std::unordered_map<uint32_t, uint64_t>  ids_;
+        std::set<deadline_t>                    deadlines_;
+    };
+}
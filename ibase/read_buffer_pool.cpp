@@ -0,0 +1,155 @@
+#include "read_buffer_pool.hpp"
+#include <atomic>
+#include <vector>
+#include "packet_pool.hpp"
+
+namespace ibase
+{
+    namespace
+    {
+        //set once the thread's pool is destroyed, buffers released later during thread exit bypass it
+        thread_local bool thread_pool_destroyed_ = false;
+
+        struct thread_pool_t
+        {
+            std::vector<bev::io_buffer*> lists_[read_buffer_pool_t::size_class_count];
+
+            ~thread_pool_t()
+            {
+                thread_pool_destroyed_ = true;
+                for (auto& list : lists_)
+                {
+                    for (auto buffer : list)
+                    {
+                        delete buffer;
+                    }
+                    list.clear();
+                }
+            }
+        };
+
+        thread_local thread_pool_t thread_pool_;
+
+        std::atomic<uint64_t> acquire_count_{0};
+        std::atomic<uint64_t> reuse_count_{0};
+        std::atomic<uint64_t> alloc_count_{0};
+        std::atomic<uint64_t> release_count_{0};
+        std::atomic<uint64_t> free_count_{0};
+        std::atomic<uint64_t> buffers_in_use_{0};
+        std::atomic<uint64_t> bytes_in_use_{0};
+        std::atomic<uint64_t> bytes_pooled_{0};
+
+        uint32_t size_class_index(uint32_t size)
+        {
+            for (uint32_t i = 0; i < read_buffer_pool_t::size_class_count; ++i)
+            {
+                if (size <= read_buffer_pool_t::size_classes[i])
+                {
+                    return i;
+                }
+            }
+            return read_buffer_pool_t::size_class_count - 1;
+        }
+
+        void release(bev::io_buffer* buffer, uint32_t index)
+        {
+            buffer->clear();
+            //mirrored storage is rounded up to whole pages, count what was really mapped
+            uint64_t length = buffer->capacity();
+
+            release_count_.fetch_add(1, std::memory_order_relaxed);
+            buffers_in_use_.fetch_sub(1, std::memory_order_relaxed);
+            bytes_in_use_.fetch_sub(length, std::memory_order_relaxed);
+
+            if (!thread_pool_destroyed_)
+            {
+                auto& list = thread_pool_.lists_[index];
+                if (list.size() < read_buffer_pool_t::max_free_buffers_per_class)
+                {
+                    list.push_back(buffer);
+                    bytes_pooled_.fetch_add(length, std::memory_order_relaxed);
+                    return;
+                }
+            }
+
+            free_count_.fetch_add(1, std::memory_order_relaxed);
+            delete buffer;
+        }
+    }
+
+    std::shared_ptr<bev::io_buffer> read_buffer_pool_t::acquire(uint32_t size)
+    {
+        acquire_count_.fetch_add(1, std::memory_order_relaxed);
+
+        auto index = size_class_index(size);
+        bev::io_buffer* buffer = nullptr;
+        if (!thread_pool_destroyed_ && !thread_pool_.lists_[index].empty())
+        {
+            auto& list = thread_pool_.lists_[index];
+            buffer = list.back();
+            list.pop_back();
+            reuse_count_.fetch_add(1, std::memory_order_relaxed);
+            bytes_pooled_.fetch_sub(buffer->capacity(), std::memory_order_relaxed);
+        }
+        else
+        {
+            buffer = new bev::io_buffer(size_classes[index], bev::io_buffer::storage_t::mirrored);
+            alloc_count_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        buffers_in_use_.fetch_add(1, std::memory_order_relaxed);
+        bytes_in_use_.fetch_add(buffer->capacity(), std::memory_order_relaxed);
+        //the control block comes from the packet pool as well
+        return std::shared_ptr<bev::io_buffer>(buffer, [index](bev::io_buffer* buffer) { release(buffer, index); }, packet_pool_allocator_t<bev::io_buffer>());
+    }
+
+    read_buffer_pool_t::stats_t read_buffer_pool_t::stats()
+    {
+        stats_t stats;
+        stats.acquire_count = acquire_count_.load(std::memory_order_relaxed);
+        stats.reuse_count = reuse_count_.load(std::memory_order_relaxed);
+        stats.alloc_count = alloc_count_.load(std::memory_order_relaxed);
+        stats.release_count = release_count_.load(std::memory_order_relaxed);
+        stats.free_count = free_count_.load(std::memory_order_relaxed);
+        stats.buffers_in_use = buffers_in_use_.load(std::memory_order_relaxed);
+        stats.bytes_in_use = bytes_in_use_.load(std::memory_order_relaxed);
+        stats.bytes_pooled = bytes_pooled_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    uint32_t read_buffer_sizer_t::size() const
+    {
+        return read_buffer_pool_t::size_classes[class_index_];
+    }
+
+    void read_buffer_sizer_t::on_read(uint32_t requested_size, uint32_t read_size)
+    {
+        drained_ = read_size < requested_size;
+        if (!drained_)
+        {
+            small_reads_ = 0;
+            if (class_index_ + 1 < read_buffer_pool_t::size_class_count)
+            {
+                ++class_index_;
+            }
+            return;
+        }
+
+        if (read_size >= size() / 4)
+        {
+            small_reads_ = 0;
+            return;
+        }
+
+        if ((++small_reads_ >= small_reads_to_shrink) && (class_index_ > 0))
+        {
+            --class_index_;
+            small_reads_ = 0;
+        }
+    }
+
+    bool read_buffer_sizer_t::drained() const
+    {
+        return drained_;
+    }
+}
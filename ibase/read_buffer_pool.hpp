@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+#include <memory>
+#include "io_buffer.hpp"
+
+namespace ibase
+{
+    //read buffers for connections, lent only while a connection has unread bytes. an idle connection waits
+    //for readability without holding one. free buffers are kept per thread like packet_pool_t, a buffer
+    //whose last reference goes away on another thread joins that thread's pool
+    class read_buffer_pool_t
+    {
+    public:
+        struct stats_t
+        {
+            uint64_t acquire_count{0};      //acquire() calls
+            uint64_t reuse_count{0};        //buffers served from a free list
+            uint64_t alloc_count{0};        //buffers newly allocated
+            uint64_t release_count{0};      //buffers given back
+            uint64_t free_count{0};         //buffers given back to the system
+            uint64_t buffers_in_use{0};     //buffers lent and not yet given back
+            uint64_t bytes_in_use{0};
+            uint64_t bytes_pooled{0};       //bytes kept in the free lists
+        };
+
+        //every class holds at least one max_packet_length frame
+        constexpr static uint32_t size_class_count = 3;
+        constexpr static uint32_t size_classes[size_class_count] = {32*1024, 64*1024, 128*1024};
+        constexpr static uint32_t max_free_buffers_per_class = 64;
+
+    public:
+        //size is rounded up to its size class and capped at the largest one, the buffer is mirrored where
+        //possible and goes back to the pool with its last reference
+        static std::shared_ptr<bev::io_buffer> acquire(uint32_t size);
+        static stats_t stats();
+    };
+
+    //picks a connection's read buffer size from its recent reads. a read that fills the whole buffer asks
+    //for the next class, a long run of reads that use little of it for the previous one
+    class read_buffer_sizer_t
+    {
+        constexpr static uint32_t small_reads_to_shrink = 16;
+
+    public:
+        uint32_t size() const;
+        void on_read(uint32_t requested_size, uint32_t read_size);
+        //the last read drained the socket, the connection can wait without a buffer
+        bool drained() const;
+    private:
+        uint32_t class_index_{0};
+        uint32_t small_reads_{0};
+        bool drained_{true};
+    };
+}
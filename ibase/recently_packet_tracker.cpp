@@ -1,53 +1,69 @@
 #include "recently_packet_tracker.hpp"
-#include <chrono>
+#include <algorithm>
 
 namespace ibase
 {
+    namespace
+    {
+        constexpr uint64_t empty_slot = 0;
+        constexpr uint32_t min_slots = 1024;
+
+        inline uint32_t slot_of(uint64_t id, size_t slot_count)
+        {
+            //fibonacci hashing, ids of one cmd differ in the low bits only
+            return (uint32_t)((id * 0x9E3779B97F4A7C15ull) >> 32) & (uint32_t)(slot_count - 1);
+        }
+    }
+
+    recently_packet_tracker_t::recently_packet_tracker_t(uint32_t max_tracked_packets)
+        : max_tracked_packets_(std::max<uint32_t>(max_tracked_packets, 1))
+        , max_slots_(min_slots)
+    {
+        //linear probing stays short while at most 3/4 of the slots are taken
+        while ((uint64_t)max_slots_ * 3 / 4 < max_tracked_packets_)
+        {
+            max_slots_ *= 2;
+        }
+    }
+
+    void recently_packet_tracker_t::advance(std::chrono::steady_clock::time_point now)
+    {
+        cur_second_ = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
+        if (cur_second_ - current_.start_second_ < max_packet_life_time_in_seconds)
+        {
+            return;
+        }
+
+        retire_previous();
+        //nothing came in for a whole lifetime, what moved over has expired as well
+        if (cur_second_ - previous_.start_second_ >= 2 * max_packet_life_time_in_seconds)
+        {
+            reset(previous_);
+            shrink(previous_, 0);
+            shrink(current_, 0);
+        }
+    }
+
     bool recently_packet_tracker_t::on_receive_packet(const uint32_t cmd, const uint32_t seq)
     {
         uint64_t id = packet_id(cmd, seq);
-        
-		auto cur_tick = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
-
-		// 60ǰյ
-		auto offset = cur_tick - first_tick_;
-		if (offset > max_packet_life_time_in_seconds - 1)
-		{
-			auto span = offset + 1 - max_packet_life_time_in_seconds;
-
-			for (auto i = 0; i < max_packet_life_time_in_seconds && i < span; ++i)
-			{
-				auto& packet_id_array = packet_time_index_array_[(first_tick_ + i) % max_packet_life_time_in_seconds];
-				for (auto& id : packet_id_array)
-				{
-					recently_packet_ids_.erase(id);
-				}
-				packet_id_array.clear();
-			}
-
-			first_index_ = (first_index_ + span) % max_packet_life_time_in_seconds;
-			offset = max_packet_life_time_in_seconds - 1;
-			first_tick_ = cur_tick - offset;
-		}
-
-		// յС¼TRUE.
-		if (recently_packet_ids_.find(id) != recently_packet_ids_.end())
-		{
-			return true;
-		}
-
-		packet_time_index_array_[(first_index_ + offset) % max_packet_life_time_in_seconds].push_back(id);
-		recently_packet_ids_.insert(id);
-		return false;
+        if (contains(current_, id) || contains(previous_, id))
+        {
+            return true;
+        }
+
+        if (current_.size_ >= max_tracked_packets_)
+        {
+            retire_previous();
+        }
+        insert(current_, id);
+        return false;
     }
 
     void recently_packet_tracker_t::clear()
     {
-        recently_packet_ids_.clear();
-        for (auto& item : packet_time_index_array_)
-        {
-            item.clear();
-        }
+        reset(current_);
+        reset(previous_);
     }
 
     uint64_t recently_packet_tracker_t::packet_id(const uint32_t cmd, const uint32_t seq)
@@ -56,4 +72,121 @@ namespace ibase
         id = (id << 32)|seq;
         return id;
     }
+
+    bool recently_packet_tracker_t::contains(const generation_t& generation, uint64_t id) const
+    {
+        if (id == empty_slot)
+        {
+            return generation.has_empty_id_;
+        }
+        if (generation.size_ == 0)
+        {
+            return false;
+        }
+
+        auto mask = generation.slots_.size() - 1;
+        for (auto slot = slot_of(id, generation.slots_.size()); ; slot = (slot + 1) & mask)
+        {
+            if (generation.slots_[slot] == id)
+            {
+                return true;
+            }
+            if (generation.slots_[slot] == empty_slot)
+            {
+                return false;
+            }
+        }
+    }
+
+    void recently_packet_tracker_t::insert(generation_t& generation, uint64_t id)
+    {
+        if (id == empty_slot)
+        {
+            generation.has_empty_id_ = true;
+            return;
+        }
+
+        if ((generation.size_ + 1) * 4 > generation.slots_.size() * 3)
+        {
+            grow(generation);
+        }
+
+        auto mask = generation.slots_.size() - 1;
+        auto slot = slot_of(id, generation.slots_.size());
+        while (generation.slots_[slot] != empty_slot)
+        {
+            slot = (slot + 1) & mask;
+        }
+        generation.slots_[slot] = id;
+        ++generation.size_;
+    }
+
+    void recently_packet_tracker_t::grow(generation_t& generation)
+    {
+        auto slot_count = std::max<size_t>(min_slots, generation.slots_.size() * 2);
+        slot_count = std::min<size_t>(slot_count, max_slots_);
+        if (slot_count == generation.slots_.size())
+        {
+            return;
+        }
+
+        std::vector<uint64_t> slots(slot_count, empty_slot);
+        for (auto id : generation.slots_)
+        {
+            if (id == empty_slot)
+            {
+                continue;
+            }
+            auto slot = slot_of(id, slot_count);
+            while (slots[slot] != empty_slot)
+            {
+                slot = (slot + 1) & (slot_count - 1);
+            }
+            slots[slot] = id;
+        }
+        generation.slots_.swap(slots);
+    }
+
+    void recently_packet_tracker_t::retire_previous()
+    {
+        //the slots of the dropped generation are kept for the next one, a busy session allocates nothing
+        //once it reached its size. slots a burst grew are given back once the load is down again
+        std::swap(previous_, current_);
+        reset(current_);
+        shrink(current_, previous_.size_);
+        current_.start_second_ = cur_second_;
+    }
+
+    void recently_packet_tracker_t::shrink(generation_t& generation, uint32_t expected_size)
+    {
+        if (expected_size == 0)
+        {
+            std::vector<uint64_t>().swap(generation.slots_);
+            return;
+        }
+
+        size_t slot_count = min_slots;
+        while (slot_count * 3 / 4 < expected_size)
+        {
+            slot_count *= 2;
+        }
+
+        //within a factor of 4 the slots are kept, a load that goes up and down a little reallocates nothing
+        if (generation.slots_.size() <= slot_count * 4)
+        {
+            return;
+        }
+        std::vector<uint64_t>(slot_count, empty_slot).swap(generation.slots_);
+    }
+
+    void recently_packet_tracker_t::reset(generation_t& generation)
+    {
+        if (generation.size_ > 0)
+        {
+            std::fill(generation.slots_.begin(), generation.slots_.end(), empty_slot);
+        }
+        generation.size_ = 0;
+        generation.has_empty_id_ = false;
+        generation.start_second_ = cur_second_;
+    }
 }
@@ -1,24 +1,54 @@
 #pragma once
-#include <set>
+#include <stdint.h>
+#include <chrono>
 #include <vector>
 
 namespace ibase
 {
-    //not thread safe
+    //remembers the (cmd, seq) of received packets so that retransmits are recognized. ids go into open
+    //addressing hash sets of two generations, the current one takes new ids and both are looked up. every
+    //max_packet_life_time_in_seconds the previous generation is dropped as a whole and the current one takes
+    //its place, so an id is remembered for one to two lifetimes and nothing is ever erased one by one.
+    //a generation holds max_tracked_packets at most and is retired early once full, which bounds the memory
+    //and under a flood shortens how long ids are remembered. a generation's slots grow with what comes in,
+    //8 bytes a slot and up to 4/3 slots an id, about 8 MB at the default cap. a generation that is reused
+    //with far more slots than the one before it needed gets smaller ones, so a burst holds memory for two
+    //lifetimes at most and an idle session keeps none.
+    //the owner feeds the clock once per batch of packets with advance(). not thread safe
     class recently_packet_tracker_t
     {
-        static constexpr uint32_t max_packet_life_time_in_seconds = 60;
-        using packet_id_set_t = std::set<uint64_t>;
-        using packet_id_vec = std::vector<uint64_t>;        
+        struct generation_t
+        {
+            std::vector<uint64_t>   slots_;
+            uint32_t                size_{0};
+            bool                    has_empty_id_{false};      //the id that doubles as the empty slot
+            int64_t                 start_second_{0};
+        };
     public:
+        constexpr static uint32_t max_packet_life_time_in_seconds = 60;
+        constexpr static uint32_t default_max_tracked_packets = 768*1024;
+
+        explicit recently_packet_tracker_t(uint32_t max_tracked_packets = default_max_tracked_packets);
+
+        void advance(std::chrono::steady_clock::time_point now);
+        //true if the packet was received before
         bool on_receive_packet(const uint32_t cmd, const uint32_t seq);
         void clear();
     private:
         uint64_t packet_id(const uint32_t cmd, const uint32_t seq);
+        bool contains(const generation_t& generation, uint64_t id) const;
+        void insert(generation_t& generation, uint64_t id);
+        void grow(generation_t& generation);
+        void retire_previous();
+        void reset(generation_t& generation);
+        //generation is empty, its slots are cut down to what expected_size needs if they are far more, and
+        //released for 0
+        void shrink(generation_t& generation, uint32_t expected_size);
     private:
-        packet_id_set_t              recently_packet_ids_;
-        packet_id_vec                packet_time_index_array_[max_packet_life_time_in_seconds];
-        uint64_t                     first_tick_{0};
-        uint32_t                     first_index_{0};
+        uint32_t                     max_tracked_packets_;
+        uint32_t                     max_slots_;
+        int64_t                      cur_second_{0};
+        generation_t                 current_;
+        generation_t                 previous_;
     };
 }
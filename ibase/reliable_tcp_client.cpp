@@ -1,16 +1,20 @@
 #include "reliable_tcp_client.hpp"
+#include <algorithm>
+#include <thread>
+#include <vector>
 #include "task_runner.hpp"
 #include <fmt/core.h>
 #include "ilogger.hpp"
+#include "control_cmd.hpp"
 
 namespace ibase
 {
     reliable_tcp_client_t::send_opt_t reliable_tcp_client_t::default_send_opt{3, 3};
 
-    reliable_tcp_client_t::reliable_tcp_client_t(asio::io_context& io_context)
+    reliable_tcp_client_t::reliable_tcp_client_t(asio::io_context& io_context, uint32_t submission_ring_size)
     : io_context_(io_context)
     , socket_(io_context)
-    , read_buf_(max_read_buffer_size)
+    , submissions_(submission_ring_size)
     , timer_(std::make_shared<itimer>(io_context))
     , connect_state_(connect_state_t::disconnected)
     {
@@ -77,10 +81,13 @@ namespace ibase
 
         do_close();
 
-        read_buf_.clear();
+        read_buf_.reset();
+        //requests submitted before stop() go the way of the others
+        drain_submissions();
         write_packets_.clear();
         notifications_.clear();
         rencently_packet_tracker_.clear();
+        reassembler_.clear();
 
         last_connect_timepoint_ = std::chrono::steady_clock::time_point();
         last_heartbeat_timepoint_ = std::chrono::steady_clock::time_point();
@@ -91,10 +98,88 @@ namespace ibase
         return started_;
     }
 
+    void reliable_tcp_client_t::set_body_checksum(bool enable)
+    {
+        body_checksum_ = enable;
+    }
+
+    void reliable_tcp_client_t::set_compression(uint8_t codec_id, uint32_t min_body_length)
+    {
+        codec_ = codec::find_codec(codec_id);
+        compress_min_length_ = min_body_length;
+    }
+
+    void reliable_tcp_client_t::set_compact_header(bool enable)
+    {
+        compact_header_ = enable;
+    }
+
     uint32_t reliable_tcp_client_t::send_req_async(uint32_t cmd, uint8_t* req_buf, uint32_t req_len, send_opt_t* opt, send_callback_t callback)
     {
-        auto packet = packet_t::build_packet(cmd, ++cur_seq_, false, req_buf, req_len);
-        if (packet == nullptr)
+        auto build_opt = make_build_opt();
+        if (req_len <= packet_t::max_body_length)
+        {
+            return send_req(packet_t::build_packet(cmd, ++cur_seq_, false, req_buf, req_len, &build_opt), {}, opt, callback, nullptr);
+        }
+        return send_req(packet_t::build_packets(cmd, ++cur_seq_, false, req_buf, req_len, &build_opt), opt, callback, nullptr);
+    }
+
+    uint32_t reliable_tcp_client_t::send_req_view_async(uint32_t cmd, uint8_t* req_buf, uint32_t req_len, send_opt_t* opt, send_view_callback_t callback)
+    {
+        auto build_opt = make_build_opt();
+        if (req_len <= packet_t::max_body_length)
+        {
+            return send_req(packet_t::build_packet(cmd, ++cur_seq_, false, req_buf, req_len, &build_opt), {}, opt, nullptr, callback);
+        }
+        return send_req(packet_t::build_packets(cmd, ++cur_seq_, false, req_buf, req_len, &build_opt), opt, nullptr, callback);
+    }
+
+    uint32_t reliable_tcp_client_t::send_req_async(uint32_t cmd, ibuffer&& req, send_opt_t* opt, send_callback_t callback)
+    {
+        auto build_opt = make_build_opt();
+        if (req.len() <= packet_t::max_body_length)
+        {
+            return send_req(packet_t::build_packet(cmd, ++cur_seq_, false, std::make_shared<ibuffer>(std::move(req)), &build_opt), {}, opt, callback, nullptr);
+        }
+        return send_req(packet_t::build_packets(cmd, ++cur_seq_, false, std::make_shared<ibuffer>(std::move(req)), &build_opt), opt, callback, nullptr);
+    }
+
+    uint32_t reliable_tcp_client_t::send_req_view_async(uint32_t cmd, ibuffer&& req, send_opt_t* opt, send_view_callback_t callback)
+    {
+        auto build_opt = make_build_opt();
+        if (req.len() <= packet_t::max_body_length)
+        {
+            return send_req(packet_t::build_packet(cmd, ++cur_seq_, false, std::make_shared<ibuffer>(std::move(req)), &build_opt), {}, opt, nullptr, callback);
+        }
+        return send_req(packet_t::build_packets(cmd, ++cur_seq_, false, std::make_shared<ibuffer>(std::move(req)), &build_opt), opt, nullptr, callback);
+    }
+
+    packet_t::build_opt_t reliable_tcp_client_t::make_build_opt()
+    {
+        return packet_t::build_opt_t{body_checksum_, codec_, compress_min_length_};
+    }
+
+    uint32_t reliable_tcp_client_t::send_req(std::vector<std::shared_ptr<packet_t>> packets, send_opt_t* opt, send_callback_t callback, send_view_callback_t view_callback)
+    {
+        if (packets.empty())
+        {
+            return 0;
+        }
+
+        //more than one packet is a request too large for one packet, the fragments go out back to back and
+        //the server reassembles or streams them
+        if (packets.size() == 1)
+        {
+            return send_req(std::move(packets.front()), {}, opt, std::move(callback), std::move(view_callback));
+        }
+
+        auto packet = packets.front();
+        return send_req(std::move(packet), std::move(packets), opt, std::move(callback), std::move(view_callback));
+    }
+
+    uint32_t reliable_tcp_client_t::send_req(std::shared_ptr<packet_t> packet, std::vector<std::shared_ptr<packet_t>> fragments, send_opt_t* opt, send_callback_t callback, send_view_callback_t view_callback)
+    {
+        if (!packet)
         {
             return 0;
         }
@@ -105,26 +190,84 @@ namespace ibase
         }
 
         auto send_id = ++cur_send_id_;
-        auto opt_copy = *opt;
-        
+        sending_packet_info packet_info{ std::move(packet), std::move(fragments), *opt, send_id, std::move(callback), std::move(view_callback), 1 };
+        if (!submit(packet_info))
+        {
+            return 0;
+        }
+        return send_id;
+    }
+
+    bool reliable_tcp_client_t::submit(sending_packet_info& packet_info)
+    {
+        while (!submissions_.try_push(packet_info))
+        {
+            //the client's own thread makes room itself, the others wait for it as long as something is left
+            //to drain the ring. going around it would reorder the requests of a thread
+            if (io_context_.get_executor().running_in_this_thread())
+            {
+                drain_submissions();
+            }
+            else if (!started_ || io_context_.stopped())
+            {
+                return false;
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        //pairs with the fence in drain_submissions: either the drain under way still sees this request, or
+        //this sees that it has finished and posts the next one
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!drain_scheduled_.exchange(true, std::memory_order_acq_rel))
+        {
+            post_drain_submissions();
+        }
+        return true;
+    }
+
+    void reliable_tcp_client_t::post_drain_submissions()
+    {
         std::weak_ptr<reliable_tcp_client_t> weak_this(shared_from_this());
-        ibase::task::run_task_in_the_iocontext_async(io_context_, [weak_this, packet, opt_copy, send_id, callback]() {
+        asio::post(io_context_, [weak_this]() {
             auto shared_this = weak_this.lock();
             if (!shared_this)
             {
                 return;
             }
 
-            shared_this->send_req_async_impl(packet, send_id, opt_copy, callback);
+            shared_this->drain_submissions();
         });
+    }
 
-        return send_id;
+    void reliable_tcp_client_t::drain_submissions()
+    {
+        //at most one ring full per wakeup, senders that keep refilling it do not starve the socket
+        sending_packet_info packet_info;
+        for (uint32_t drained = 0; (drained < submissions_.capacity()) && submissions_.try_pop(packet_info); ++drained)
+        {
+            send_req_async_impl(std::move(packet_info));
+            packet_info = sending_packet_info();
+        }
+
+        drain_scheduled_.store(false, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!submissions_.empty() && !drain_scheduled_.exchange(true, std::memory_order_acq_rel))
+        {
+            post_drain_submissions();
+        }
     }
 
-    void reliable_tcp_client_t::send_req_async_impl(std::shared_ptr<packet_t> packet, uint32_t send_id, send_opt_t opt, send_callback_t callback)
+    void reliable_tcp_client_t::send_req_async_impl(sending_packet_info packet_info)
     {
-        write_packets_.push_back({ packet, opt, send_id, callback, 1, std::chrono::steady_clock::now() });
-        do_write_packet(packet);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(packet_info.send_opt_.interval_seconds);
+        auto cmd = packet_info.packet_->cmd();
+        auto seq = packet_info.packet_->seq();
+        auto send_id = packet_info.send_id_;
+        auto& pending = write_packets_.insert(cmd, seq, send_id, std::move(packet_info), deadline);
+        do_write_sending_packet(pending);
     }
 
     void reliable_tcp_client_t::send_cancel(uint32_t send_id)
@@ -143,34 +286,47 @@ namespace ibase
 
     void reliable_tcp_client_t::send_cancel_impl(uint32_t send_id)
     {
-        for (auto it = write_packets_.begin(); it != write_packets_.end(); ++it)
-        {
-            if (it->send_id_ == send_id)
-            {
-                write_packets_.erase(it);
-                break;
-            }
-        }
+        //the request may still wait in the ring, its drain can be posted after this
+        drain_submissions();
+
+        sending_packet_info packet_info;
+        write_packets_.take_by_id(send_id, packet_info);
     }
 
     void reliable_tcp_client_t::subscribe_notification(uint32_t cmd, notification_callback_t callback)
+    {
+        subscribe(cmd, {callback, nullptr});
+    }
+
+    void reliable_tcp_client_t::subscribe_notification_view(uint32_t cmd, notification_view_callback_t callback)
+    {
+        subscribe(cmd, {nullptr, callback});
+    }
+
+    void reliable_tcp_client_t::subscribe(uint32_t cmd, notification_handler_t handler)
     {
         std::weak_ptr<reliable_tcp_client_t> weak_this(shared_from_this());
 
-        ibase::task::run_task_in_the_iocontext_async(io_context_, [weak_this, cmd, callback]() {
+        ibase::task::run_task_in_the_iocontext_async(io_context_, [weak_this, cmd, handler]() {
             auto shared_this = weak_this.lock();
             if (!shared_this)
             {
                 return;
             }
 
-            shared_this->subscribe_notification_impl(cmd, callback);
+            shared_this->subscribe_notification_impl(cmd, handler);
         });
     }
 
-    void reliable_tcp_client_t::subscribe_notification_impl(uint32_t cmd, notification_callback_t callback)
+    void reliable_tcp_client_t::subscribe_notification_impl(uint32_t cmd, notification_handler_t handler)
     {
-        notifications_[cmd] = callback;
+        bool subscribed = (notifications_.find(cmd) != notifications_.end());
+        notifications_[cmd] = handler;
+        //while disconnected the hello on the next connect takes care of it
+        if (!subscribed && is_connected())
+        {
+            send_subscriptions(control_cmd::subscribe_cmd, {cmd});
+        }
     }
 
     void reliable_tcp_client_t::unsubscribe_notification(uint32_t cmd)
@@ -189,7 +345,10 @@ namespace ibase
 
     void reliable_tcp_client_t::unsubscribe_notification_impl(uint32_t cmd)
     {
-        notifications_.erase(cmd);
+        if ((notifications_.erase(cmd) > 0) && is_connected())
+        {
+            send_subscriptions(control_cmd::unsubscribe_cmd, {cmd});
+        }
     }
 
     void reliable_tcp_client_t::do_close()
@@ -202,7 +361,13 @@ namespace ibase
         ibase::logger::write_log(ibase::logger::log_level_debug, fmt::format("client do_close"));
 
         read_pending_ = false;
+        write_pending_ = false;
+        read_buf_.reset();
+        send_queue_.clear();
+        header_format_ = packet_t::header_format_t::classic;
         connect_state_ = connect_state_t::disconnected;
+        //the rest of a half received message is gone with the connection, the server resends it as a whole
+        reassembler_.clear();
         if (socket_.is_open())
         {
             ibase::logger::write_log(ibase::logger::log_level_debug, "client really do_close");
@@ -258,17 +423,24 @@ namespace ibase
             return;
         }
         
-        auto size_to_read = (read_buf_.free_size() > 0) ? read_buf_.free_size() : read_buf_.capacity();
+        //nothing buffered, wait for the peer without holding a buffer
+        if (!read_buf_)
+        {
+            do_wait_readable();
+            return;
+        }
+
+        auto size_to_read = (read_buf_->free_size() > 0) ? read_buf_->free_size() : read_buf_->capacity();
         if (size_to_read <= 0)
         {
             return;
         }
 
         read_pending_ = true;
-        auto buf = read_buf_.prepare(size_to_read);
+        auto buf = read_buf_->prepare(size_to_read);
 
         std::weak_ptr<reliable_tcp_client_t> weak_this(shared_from_this());
-        socket_.async_read_some(asio::buffer(buf.data, buf.size), [weak_this](std::error_code ec, std::size_t length) {
+        socket_.async_read_some(asio::buffer(buf.data, buf.size), [weak_this, read_buf = read_buf_, requested_size = (uint32_t)buf.size](std::error_code ec, std::size_t length) mutable {
             auto shared_this = weak_this.lock();
             if (!shared_this)
             {
@@ -276,18 +448,50 @@ namespace ibase
             }
 
             shared_this->read_pending_ = false;
+            //the chunk was only held for the read, from here on recycle_read_buffer() counts the views
+            //callbacks keep
+            auto current = (shared_this->read_buf_ == read_buf);
+            read_buf.reset();
             
             if (ec)
             {
                 shared_this->do_close();
             }
-            else
+            //a closed connection gave its buffer back while the read was in flight
+            else if (current)
             {
+                shared_this->read_buffer_sizer_.on_read(requested_size, (uint32_t)length);
                 shared_this->process_read_data(length);
             }
         });
     }
 
+    void reliable_tcp_client_t::do_wait_readable()
+    {
+        read_pending_ = true;
+
+        std::weak_ptr<reliable_tcp_client_t> weak_this(shared_from_this());
+        socket_.async_wait(asio::ip::tcp::socket::wait_read, [weak_this](std::error_code ec) {
+            auto shared_this = weak_this.lock();
+            if (!shared_this)
+            {
+                return;
+            }
+
+            shared_this->read_pending_ = false;
+
+            if (ec)
+            {
+                shared_this->do_close();
+            }
+            else
+            {
+                shared_this->acquire_read_buffer();
+                shared_this->do_read_packet();
+            }
+        });
+    }
+
     void reliable_tcp_client_t::do_write_packet(const std::shared_ptr<packet_t> packet)
     {
         if (!packet)
@@ -300,9 +504,65 @@ namespace ibase
             return;
         }
         
+        send_queue_.push_back(packet);
+        do_send_queue();
+    }
+
+    void reliable_tcp_client_t::do_write_packets(const std::vector<std::shared_ptr<packet_t>>& packets)
+    {
+        if (!is_connected())
+        {
+            return;
+        }
+
+        send_queue_.insert(send_queue_.end(), packets.begin(), packets.end());
+        do_send_queue();
+    }
+
+    void reliable_tcp_client_t::do_send_queue()
+    {
+        //one write at a time, concurrent async_write calls could interleave their bytes on the socket
+        if (write_pending_ || send_queue_.empty())
+        {
+            return;
+        }
+        write_pending_ = true;
+
+        //everything queued while the last write was in flight goes out in one gather write, capped in bytes
+        //and pieces. header, body and trailer of a packet are separate pieces, a body may still be the
+        //caller's buffer. the batch stays alive in the handler until the write is done
+        std::vector<std::shared_ptr<packet_t>> batch;
+        std::vector<asio::const_buffer> buffers;
+        buffers.reserve(max_write_batch_buffers);
+        uint32_t batch_bytes = 0;
+        while (!send_queue_.empty())
+        {
+            packet_t::segment_t segments[packet_t::max_segments];
+            auto compact_header = compact_headers_ ? compact_headers_.get() + batch.size() * packet_t::max_compact_header_length : nullptr;
+            auto segment_count = send_queue_.front()->segments(segments, header_format_, compact_header);
+            uint32_t packet_bytes = 0;
+            for (uint32_t i = 0; i < segment_count; ++i)
+            {
+                packet_bytes += segments[i].length;
+            }
+
+            if (!batch.empty() && ((buffers.size() + segment_count > max_write_batch_buffers) || (batch_bytes + packet_bytes > max_write_batch_bytes)))
+            {
+                break;
+            }
+
+            for (uint32_t i = 0; i < segment_count; ++i)
+            {
+                buffers.push_back(asio::buffer(segments[i].data, segments[i].length));
+            }
+            batch_bytes += packet_bytes;
+            batch.push_back(std::move(send_queue_.front()));
+            send_queue_.pop_front();
+        }
+
         std::weak_ptr<reliable_tcp_client_t> weak_this(shared_from_this());
-        asio::async_write(socket_, asio::buffer(packet->data(), packet->length()),
-          [weak_this](std::error_code ec, std::size_t length)
+        asio::async_write(socket_, buffers,
+          [weak_this, batch = std::move(batch)](std::error_code ec, std::size_t)
           {
             auto shared_this = weak_this.lock();
             if (!shared_this)
@@ -313,15 +573,33 @@ namespace ibase
             if (ec)
             {
                 shared_this->do_close();
+                return;
             }
+
+            shared_this->write_pending_ = false;
+            shared_this->do_send_queue();
           });
     }
 
+    void reliable_tcp_client_t::do_write_sending_packet(const sending_packet_info& packet_info)
+    {
+        if (packet_info.fragments_.empty())
+        {
+            do_write_packet(packet_info.packet_);
+        }
+        else
+        {
+            do_write_packets(packet_info.fragments_);
+        }
+    }
+
 
     void reliable_tcp_client_t::process_read_data(uint32_t read_data_size) {
         if (read_data_size > 0)
         {
-            read_buf_.commit(read_data_size);
+            read_buf_->commit(read_data_size);
+            //one clock read for everything this read brought in
+            rencently_packet_tracker_.advance(std::chrono::steady_clock::now());
             process_packet();
         }
 
@@ -330,18 +608,42 @@ namespace ibase
 
     void reliable_tcp_client_t::process_packet() {
         do {
+            //a callback closed the connection and gave the buffer back
+            if (!read_buf_)
+            {
+                break;
+            }
+
             uint32_t consume_len = 0;
-            auto packet = packet_t::parse_packet(read_buf_.read_head(), read_buf_.size(), consume_len);
-            read_buf_.consume(consume_len);
+            packet_view_t packet;
+            auto parsed = packet_t::parse_packet_view(read_buf_->read_head(), read_buf_->size(), consume_len, packet);
+            read_buf_->consume(consume_len);
 
-            if (!packet)
+            if (!parsed)
             {
                 break;
             }
+            packet.set_chunk(&read_buf_);
 
-            ibase::logger::write_log(ibase::logger::log_level_debug, fmt::format("client recv packet, cmd =  {}, seq = {}", packet->cmd(), packet->seq()));
+            if (packet.is_compressed())
+            {
+                packet = packet.decompress();
+                if (packet.data() == nullptr)
+                {
+                    ibase::logger::write_log(ibase::logger::log_level_warn, "client drop packet, can not decompress body");
+                    continue;
+                }
+            }
+
+            ibase::logger::write_log(ibase::logger::log_level_debug, fmt::format("client recv packet, cmd =  {}, seq = {}", packet.cmd(), packet.seq()));
+
+            if (control_cmd::is_control_cmd(packet.cmd()))
+            {
+                process_control_packet(packet);
+                continue;
+            }
             
-            if (packet->is_push())
+            if (packet.is_push())
             {
                 process_push_packet(packet);
             }
@@ -350,31 +652,81 @@ namespace ibase
                 process_response_packet(packet);
             }
         } while (1);
+
+        recycle_read_buffer();
     }
 
-    void reliable_tcp_client_t::process_response_packet(const std::shared_ptr<packet_t> packet)
+    void reliable_tcp_client_t::acquire_read_buffer()
     {
-        for (auto it = write_packets_.begin(); it != write_packets_.end(); ++it)
+        read_buf_size_ = read_buffer_sizer_.size();
+        read_buf_ = read_buffer_pool_t::acquire(read_buf_size_);
+    }
+
+    void reliable_tcp_client_t::recycle_read_buffer()
+    {
+        if (!read_buf_)
         {
-            if ((it->packet_->cmd() == packet->cmd()) && (it->packet_->seq() == packet->seq()))
-            {
-                sending_packet_info packet_info = *it;
-                write_packets_.erase(it);
+            return;
+        }
 
-                do_send_req_callback(packet_info.callback_, packet_info.send_id_, 0, packet);
-                break;
+        //everything parsed and the socket drained, hibernate until the peer sends again
+        if ((read_buf_->size() == 0) && read_buffer_sizer_.drained())
+        {
+            read_buf_.reset();
+            return;
+        }
+
+        //a callback kept views into this chunk alive or the traffic asks for another size, move the unread
+        //tail to a fresh chunk instead of overwriting them
+        if ((read_buf_.use_count() <= 1) && (read_buf_size_ == read_buffer_sizer_.size()))
+        {
+            return;
+        }
+
+        auto read_buf = std::move(read_buf_);
+        acquire_read_buffer();
+        auto unread_size = read_buf->size();
+        if (unread_size > 0)
+        {
+            auto slab = read_buf_->prepare(unread_size);
+            memcpy(slab.data, read_buf->read_head(), unread_size);
+            read_buf_->commit(unread_size);
+        }
+    }
+
+    void reliable_tcp_client_t::process_response_packet(const packet_view_t& packet)
+    {
+        if (packet.is_fragment())
+        {
+            auto message = reassembler_.on_fragment(packet);
+            if (message)
+            {
+                process_response_packet(packet_view_t::from_packet(message));
             }
+            return;
+        }
+
+        sending_packet_info packet_info;
+        if (write_packets_.take(pending_packets_t::make_key(packet.cmd(), packet.seq()), packet_info))
+        {
+            do_send_req_callback(packet_info, 0, packet);
         }
     }
 
-    void reliable_tcp_client_t::process_push_packet(const std::shared_ptr<packet_t> packet)
+    void reliable_tcp_client_t::process_push_packet(const packet_view_t& packet)
     {
+        if (packet.is_fragment())
+        {
+            process_push_fragment(packet);
+            return;
+        }
+
         ack_push_packet(packet);
         
-        auto duplicate = rencently_packet_tracker_.on_receive_packet(packet->cmd(), packet->seq());
+        auto duplicate = rencently_packet_tracker_.on_receive_packet(packet.cmd(), packet.seq());
         if (!duplicate)
         {
-            auto it = notifications_.find(packet->cmd());
+            auto it = notifications_.find(packet.cmd());
             if (it != notifications_.end())
             {
                 do_recv_notification_callback(it->second, packet);
@@ -382,14 +734,49 @@ namespace ibase
         }
     }
 
-    void reliable_tcp_client_t::ack_push_packet(const std::shared_ptr<packet_t> packet)
+    void reliable_tcp_client_t::process_push_fragment(const packet_view_t& packet)
+    {
+        //the server tracks a fragmented notification as one message, ack it once with the last fragment
+        if (packet.is_last_fragment())
+        {
+            ack_push_packet(packet);
+        }
+
+        if (packet.fragment_offset() == 0)
+        {
+            auto duplicate = rencently_packet_tracker_.on_receive_packet(packet.cmd(), packet.seq());
+            if (duplicate)
+            {
+                reassembler_.skip(packet);
+                return;
+            }
+        }
+        else if (reassembler_.skipping(packet))
+        {
+            return;
+        }
+
+        auto message = reassembler_.on_fragment(packet);
+        if (!message)
+        {
+            return;
+        }
+
+        auto it = notifications_.find(message->cmd());
+        if (it != notifications_.end())
+        {
+            do_recv_notification_callback(it->second, packet_view_t::from_packet(message));
+        }
+    }
+
+    void reliable_tcp_client_t::ack_push_packet(const packet_view_t& packet)
     {
         if (!is_connected())
         {
             return;
         }
 
-        auto rsp_packet = packet_t::build_packet(packet->cmd(), packet->seq(), true, nullptr, 0);
+        auto rsp_packet = packet_t::build_packet(packet.cmd(), packet.seq(), true, nullptr, 0);
         do_write_packet(rsp_packet);
     }
 
@@ -426,28 +813,28 @@ namespace ibase
 
     void reliable_tcp_client_t::do_resender_check(const std::chrono::steady_clock::time_point& cur_time_point)
     {
-        for (auto it = write_packets_.begin(); it != write_packets_.end(); )
+        std::vector<uint64_t> due_keys;
+        write_packets_.collect_due(cur_time_point, due_keys);
+        for (auto key : due_keys)
         {
-            auto time_passed_by_seconds = std::chrono::duration_cast<std::chrono::seconds>(cur_time_point - it->last_send_time_point_);
-
-            if (time_passed_by_seconds.count() < it->send_opt_.interval_seconds)
+            //a callback may have cancelled it or stopped the client
+            auto packet_info = write_packets_.find(key);
+            if (packet_info == nullptr)
             {
-                ++it;
                 continue;
             }
 
-            if (it->cur_tries_ >= it->send_opt_.tries)
+            if (packet_info->cur_tries_ >= packet_info->send_opt_.tries)
             {
-                do_send_req_callback(it->callback_, it->send_id_, -1, it->packet_);
-                it = write_packets_.erase(it);
+                sending_packet_info expired;
+                write_packets_.take(key, expired);
+                do_send_req_callback(expired, -1, packet_view_t::from_packet(expired.packet_));
                 continue;
             }
 
-            ++it->cur_tries_;
-            it->last_send_time_point_ = cur_time_point;
-            do_write_packet(it->packet_);
-
-            ++it;
+            ++packet_info->cur_tries_;
+            write_packets_.reschedule(key, cur_time_point + std::chrono::seconds(packet_info->send_opt_.interval_seconds));
+            do_write_sending_packet(*packet_info);
         }
     }
 
@@ -472,9 +859,59 @@ namespace ibase
     void reliable_tcp_client_t::on_connected()
     {
         connect_state_ = connect_state_t::connected;
+        send_hello();
         do_read_packet();
     }
 
+    void reliable_tcp_client_t::send_hello()
+    {
+        uint32_t capabilities = control_cmd::capability_subscriptions;
+        if (compact_header_)
+        {
+            capabilities |= control_cmd::capability_compact_header;
+        }
+        uint8_t body[control_cmd::capabilities_length];
+        control_cmd::encode_capabilities(capabilities, body);
+        do_write_packet(packet_t::build_packet(control_cmd::hello_cmd, ++cur_seq_, false, body, sizeof(body)));
+
+        //a new connection is a new session on the server, which knows nothing of what was subscribed before
+        std::vector<uint32_t> cmds;
+        for (const auto& notification : notifications_)
+        {
+            cmds.push_back(notification.first);
+        }
+        send_subscriptions(control_cmd::subscribe_cmd, cmds);
+    }
+
+    void reliable_tcp_client_t::send_subscriptions(uint32_t control, const std::vector<uint32_t>& cmds)
+    {
+        for (size_t pos = 0; pos < cmds.size(); pos += control_cmd::max_cmds_per_packet)
+        {
+            auto count = std::min<size_t>(control_cmd::max_cmds_per_packet, cmds.size() - pos);
+            std::vector<uint8_t> body;
+            control_cmd::encode_cmds(std::vector<uint32_t>(cmds.begin() + pos, cmds.begin() + pos + count), body);
+            do_write_packet(packet_t::build_packet(control, ++cur_seq_, false, body.data(), (uint32_t)body.size()));
+        }
+    }
+
+    void reliable_tcp_client_t::process_control_packet(const packet_view_t& packet)
+    {
+        if ((packet.cmd() != control_cmd::hello_cmd) || packet.is_push())
+        {
+            return;
+        }
+
+        uint32_t peer_capabilities = control_cmd::decode_capabilities(packet.body(), packet.body_length());
+        if (compact_header_ && ((peer_capabilities & control_cmd::capability_compact_header) != 0))
+        {
+            header_format_ = packet_t::header_format_t::compact;
+            if (!compact_headers_)
+            {
+                compact_headers_.reset(new uint8_t[max_write_batch_buffers * packet_t::max_compact_header_length]);
+            }
+        }
+    }
+
 
     bool reliable_tcp_client_t::is_connected()
     {
@@ -486,13 +923,27 @@ namespace ibase
         return connect_state_ == connect_state_t::connecting;
     }
 
-    void reliable_tcp_client_t::do_send_req_callback(send_callback_t callback, uint32_t send_id, int result, std::shared_ptr<packet_t> packet)
+    void reliable_tcp_client_t::do_send_req_callback(const sending_packet_info& packet_info, int result, const packet_view_t& packet)
     {
-        callback(send_id, result, packet);
+        if (packet_info.view_callback_)
+        {
+            packet_info.view_callback_(packet_info.send_id_, result, packet);
+        }
+        else if (packet_info.callback_)
+        {
+            packet_info.callback_(packet_info.send_id_, result, packet.copy());
+        }
     }
 
-    void reliable_tcp_client_t::do_recv_notification_callback(notification_callback_t callback, std::shared_ptr<packet_t> packet)
+    void reliable_tcp_client_t::do_recv_notification_callback(const notification_handler_t& handler, const packet_view_t& packet)
     {
-        callback(packet);
+        if (handler.view_callback_)
+        {
+            handler.view_callback_(packet);
+        }
+        else if (handler.callback_)
+        {
+            handler.callback_(packet.copy());
+        }
     }
 }
@@ -1,14 +1,21 @@
 #pragma once
 #include <asio.hpp>
 #include <chrono>
-#include <list>
+#include <deque>
 #include <map>
 #include <memory>
 #include <vector>
 #include "io_buffer.hpp"
+#include "read_buffer_pool.hpp"
 #include "packet.hpp"
+#include "codec.hpp"
+#include "ibuffer.hpp"
 #include "itimer.hpp"
 #include "recently_packet_tracker.hpp"
+#include "message_reassembler.hpp"
+#include "pending_packet_table.hpp"
+#include "mpsc_ring.hpp"
+#include "typed_message.hpp"
 
 namespace ibase
 {
@@ -25,6 +32,16 @@ namespace ibase
         
         using send_callback_t = std::function<void(uint32_t send_id, int result, std::shared_ptr<packet_t> packet)>;
         using notification_callback_t = std::function<void(std::shared_ptr<packet_t> packet)>;
+        //zero-copy variants, the view points into the read buffer and is only valid during the call
+        using send_view_callback_t = std::function<void(uint32_t send_id, int result, const packet_view_t& packet)>;
+        using notification_view_callback_t = std::function<void(const packet_view_t& packet)>;
+        //typed variants, see typed_message.hpp. rsp is nullptr unless result is 0
+        template<typename rsp_t>
+        using typed_send_callback_t = std::function<void(uint32_t send_id, int result, const rsp_t* rsp)>;
+        template<typename message_t>
+        using typed_notification_callback_t = std::function<void(const message_t& notification)>;
+        //result of a typed request whose response arrived but did not decode
+        constexpr static int result_decode_failed = -2;
 
         struct send_opt_t
         {
@@ -38,25 +55,40 @@ namespace ibase
         struct sending_packet_info
         {
             std::shared_ptr<packet_t> packet_;
+            std::vector<std::shared_ptr<packet_t>> fragments_;   //all fragments when packet_ starts a fragmented message
             send_opt_t send_opt_;
             uint32_t send_id_{0};
             send_callback_t callback_;
+            send_view_callback_t view_callback_;
             uint32_t cur_tries_{0};
-            std::chrono::steady_clock::time_point last_send_time_point_;
         };
         
-        using packet_list_t = std::list<sending_packet_info>;
-        using map_cmd_2_notification_callback_t = std::map<uint32_t, notification_callback_t>;
+        struct notification_handler_t
+        {
+            notification_callback_t callback_;
+            notification_view_callback_t view_callback_;
+        };
+        
+        //by (cmd, seq) for the response and by send id for cancelling, the resend deadline is kept there too
+        using pending_packets_t = pending_packet_table_t<sending_packet_info>;
+        using packet_queue_t = std::deque<std::shared_ptr<packet_t>>;
+        using map_cmd_2_notification_callback_t = std::map<uint32_t, notification_handler_t>;
 
-        constexpr static uint32_t max_read_buffer_size = 128*1024;
         constexpr static uint32_t reconnect_interval_seconds = 5;
         constexpr static uint32_t heartbeat_interval_seconds = 5;
+        //one gather write takes at most this much of the send queue, asio hands at most 64 pieces to writev
+        constexpr static uint32_t max_write_batch_bytes = 256*1024;
+        constexpr static uint32_t max_write_batch_buffers = 64;
+        //requests handed over by other threads and not taken by the client's thread yet. a full ring makes
+        //the senders wait for it, or fails the send once the client or its io_context has stopped
+        constexpr static uint32_t default_submission_ring_size = 256;
 
         constexpr static uint32_t heartbeat_cmd = 0;
 
 
     public:
-        reliable_tcp_client_t(asio::io_context& io_context);
+        //the ring slots are made up front, a few hundred bytes each
+        reliable_tcp_client_t(asio::io_context& io_context, uint32_t submission_ring_size = default_submission_ring_size);
         ~reliable_tcp_client_t();
         reliable_tcp_client_t(const reliable_tcp_client_t& other) = delete;
         reliable_tcp_client_t(reliable_tcp_client_t&& other) = delete;
@@ -66,31 +98,70 @@ namespace ibase
         bool start(std::string host, const uint16_t port);
         void stop();
         bool started();
+        //append a crc32c to every request body, the server verifies it and drops corrupted frames
+        void set_body_checksum(bool enable);
+        //compress every request body of at least min_body_length bytes with a registered codec,
+        //codec::no_codec_id turns it off. the peer must have the codec registered as well
+        void set_compression(uint8_t codec_id, uint32_t min_body_length = packet_t::default_compress_min_length);
+        //ask the server for the compact header on every connect, on by default
+        void set_compact_header(bool enable);
         
+        //the send id, 0 when the request is not sent
         uint32_t send_req_async(uint32_t cmd, uint8_t*req_buf, uint32_t req_len, send_opt_t* opt, send_callback_t callback);
+        uint32_t send_req_view_async(uint32_t cmd, uint8_t*req_buf, uint32_t req_len, send_opt_t* opt, send_view_callback_t callback);
+        //takes the request body over and writes it to the socket from there, without copying
+        uint32_t send_req_async(uint32_t cmd, ibuffer&& req, send_opt_t* opt, send_callback_t callback);
+        uint32_t send_req_view_async(uint32_t cmd, ibuffer&& req, send_opt_t* opt, send_view_callback_t callback);
+        //encodes the request straight into the packets, the response is decoded before the callback runs
+        template<typename rsp_t, typename req_t>
+        uint32_t send_req_async(const req_t& req, send_opt_t* opt, typed_send_callback_t<rsp_t> callback);
         void send_cancel(uint32_t send_id);
 
+        //the server is told, so it pushes only what is subscribed to. an older server pushes everything and
+        //the rest is dropped here
         void subscribe_notification(uint32_t cmd, notification_callback_t callback);
+        void subscribe_notification_view(uint32_t cmd, notification_view_callback_t callback);
+        //notifications that do not decode are dropped
+        template<typename message_t>
+        void subscribe_notification(typed_notification_callback_t<message_t> callback);
         void unsubscribe_notification(uint32_t cmd);
 
     private:
         bool start_impl(std::string host, const uint16_t port);
         void stop_impl();
-        void send_req_async_impl(std::shared_ptr<packet_t> packet, uint32_t send_id, send_opt_t opt, send_callback_t callback);
+        uint32_t send_req(std::vector<std::shared_ptr<packet_t>> packets, send_opt_t* opt, send_callback_t callback, send_view_callback_t view_callback);
+        //a request that fits into one packet comes without fragments and needs no vector
+        uint32_t send_req(std::shared_ptr<packet_t> packet, std::vector<std::shared_ptr<packet_t>> fragments, send_opt_t* opt, send_callback_t callback, send_view_callback_t view_callback);
+        packet_t::build_opt_t make_build_opt();
+        bool submit(sending_packet_info& packet_info);
+        void post_drain_submissions();
+        void drain_submissions();
+        void send_req_async_impl(sending_packet_info packet_info);
         void send_cancel_impl(uint32_t send_id);
-        void subscribe_notification_impl(uint32_t cmd, notification_callback_t callback);
+        void subscribe(uint32_t cmd, notification_handler_t handler);
+        void subscribe_notification_impl(uint32_t cmd, notification_handler_t handler);
         void unsubscribe_notification_impl(uint32_t cmd);
     private:
         void do_close();
         void do_connect();
         void do_read_packet();
         void do_write_packet(const std::shared_ptr<packet_t> packet);
+        void do_write_packets(const std::vector<std::shared_ptr<packet_t>>& packets);
+        void do_write_sending_packet(const sending_packet_info& packet_info);
+        void do_send_queue();
         
         void process_read_data(uint32_t read_data_size);
         void process_packet();
-        void process_response_packet(const std::shared_ptr<packet_t> packet);
-        void process_push_packet(const std::shared_ptr<packet_t> packet);
-        void ack_push_packet(const std::shared_ptr<packet_t> packet);
+        void process_response_packet(const packet_view_t& packet);
+        void process_push_packet(const packet_view_t& packet);
+        void process_push_fragment(const packet_view_t& packet);
+        void ack_push_packet(const packet_view_t& packet);
+        void process_control_packet(const packet_view_t& packet);
+        void send_hello();
+        void send_subscriptions(uint32_t control, const std::vector<uint32_t>& cmds);
+        void do_wait_readable();
+        void acquire_read_buffer();
+        void recycle_read_buffer();
         
         void on_priodically_timer();
         void do_reconnect_check(const std::chrono::steady_clock::time_point& cur_time_point);
@@ -101,19 +172,37 @@ namespace ibase
         bool is_connected();
         bool is_connecting();
         
-        void do_send_req_callback(send_callback_t callback, uint32_t send_id, int result, std::shared_ptr<packet_t> packet);
-        void do_recv_notification_callback(notification_callback_t callback, std::shared_ptr<packet_t> packet);
+        void do_send_req_callback(const sending_packet_info& packet_info, int result, const packet_view_t& packet);
+        void do_recv_notification_callback(const notification_handler_t& handler, const packet_view_t& packet);
     private:
         asio::io_context&                                           io_context_;
         asio::ip::tcp::socket                                       socket_;
         std::string                                                 host_;
         uint16_t                                                    port_{0};
         volatile std::atomic<bool>                                  started_ {false};
+        std::atomic<bool>                                           body_checksum_ {false};
+        std::atomic<const codec_t*>                                 codec_ {nullptr};
+        std::atomic<uint32_t>                                       compress_min_length_ {packet_t::default_compress_min_length};
+        std::atomic<bool>                                           compact_header_ {true};
+        //negotiated per connection by hello
+        packet_t::header_format_t                                   header_format_{packet_t::header_format_t::classic};
+        //the compact headers of the batch being written, only made once a connection switched to them
+        std::unique_ptr<uint8_t[]>                                  compact_headers_;
         
         //read need to sequence, because all reads use the same buffer
         bool                                                        read_pending_{false};
-        bev::io_buffer                                              read_buf_;
-        packet_list_t                                               write_packets_;
+        //borrowed from read_buffer_pool_t only while there is something to read, null while idle
+        std::shared_ptr<bev::io_buffer>                             read_buf_;
+        uint32_t                                                    read_buf_size_{0};
+        read_buffer_sizer_t                                         read_buffer_sizer_;
+        pending_packets_t                                           write_packets_;
+        //one gather write at a time takes what has queued up, write_pending_ is set while it is in flight
+        packet_queue_t                                              send_queue_;
+        bool                                                        write_pending_{false};
+        //filled by any thread, drained on the client's thread. drain_scheduled_ is set while a drain is
+        //posted or running, only the sender that sets it posts one
+        mpsc_ring_t<sending_packet_info>                            submissions_;
+        std::atomic<bool>                                           drain_scheduled_{false};
         map_cmd_2_notification_callback_t                           notifications_;
         
         std::atomic<uint32_t>                                       cur_seq_{0};
@@ -133,5 +222,51 @@ namespace ibase
         
         
         recently_packet_tracker_t                                   rencently_packet_tracker_;
+        message_reassembler_t                                       reassembler_;
     };
+
+    template<typename rsp_t, typename req_t>
+    uint32_t reliable_tcp_client_t::send_req_async(const req_t& req, send_opt_t* opt, typed_send_callback_t<rsp_t> callback)
+    {
+        static_assert(rsp_t::cmd == req_t::cmd, "a response carries the cmd of its request");
+        auto build_opt = make_build_opt();
+        send_view_callback_t view_callback = [callback](uint32_t send_id, int result, const packet_view_t& packet) {
+            if (!callback)
+            {
+                return;
+            }
+
+            if (result != 0)
+            {
+                callback(send_id, result, nullptr);
+                return;
+            }
+
+            rsp_t rsp;
+            if (!message::decode(packet, rsp))
+            {
+                callback(send_id, result_decode_failed, nullptr);
+                return;
+            }
+            callback(send_id, 0, &rsp);
+        };
+
+        if (req.encoded_length() <= packet_t::max_body_length)
+        {
+            return send_req(message::encode_packet(req, ++cur_seq_, false, &build_opt), {}, opt, nullptr, std::move(view_callback));
+        }
+        return send_req(message::encode_packets(req, ++cur_seq_, false, &build_opt), opt, nullptr, std::move(view_callback));
+    }
+
+    template<typename message_t>
+    void reliable_tcp_client_t::subscribe_notification(typed_notification_callback_t<message_t> callback)
+    {
+        subscribe_notification_view(message_t::cmd, [callback](const packet_view_t& packet) {
+            message_t notification;
+            if (callback && message::decode(packet, notification))
+            {
+                callback(notification);
+            }
+        });
+    }
 }
@@ -2,28 +2,72 @@
 #include "reliable_tcp_session.hpp"
 #include "task_runner.hpp"
 #include "ilogger.hpp"
+#include "control_cmd.hpp"
 #include <fmt/core.h>
 
 namespace ibase
 {
-    reliable_tcp_server_t::reliable_tcp_server_t(asio::io_context& io_context, const uint16_t port)
+    reliable_tcp_server_t::shard_t::shard_t(asio::io_context& io_context, uint32_t index, uint32_t index_bits)
         : io_context_(io_context)
+        , index_(index)
+        , sessions_(index_bits, index)
         , timer_(std::make_shared<itimer>(io_context))
+    {
+    }
+
+    reliable_tcp_server_t::reliable_tcp_server_t(asio::io_context& io_context, const uint16_t port)
+        : reliable_tcp_server_t(io_context, port, server_opt_t())
+    {
+    }
+
+    reliable_tcp_server_t::reliable_tcp_server_t(asio::io_context& io_context, const uint16_t port, server_opt_t opt)
+        : io_context_(io_context)
+        , acceptor_(io_context)
         , port_(port)
-        , acceptor_(io_context, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port))
-        
+        , opt_(opt)
     {
+        if (opt_.handler_thread_count > 0)
+        {
+            handler_pool_ = std::make_unique<ithread_pool>(opt_.handler_thread_count);
+        }
+
+        if (opt_.worker_count == 0)
+        {
+            shards_.push_back(std::make_unique<shard_t>(io_context_, 0, 0));
+            return;
+        }
+
+        while ((1u << shard_bits_) < opt_.worker_count)
+        {
+            ++shard_bits_;
+        }
+        for (uint32_t i = 0; i < opt_.worker_count; ++i)
+        {
+            workers_.push_back(std::make_unique<ithread>());
+            shards_.push_back(std::make_unique<shard_t>(workers_.back()->get_io_context(), i, shard_bits_));
+        }
     }
 
     reliable_tcp_server_t::~reliable_tcp_server_t()
     {
+        //no worker may run a session while it goes away, and the sessions have to go before the io_contexts
+        //their sockets belong to. handlers still queued are dropped, none runs against a server that is gone
+        if (handler_pool_)
+        {
+            handler_pool_->stop();
+        }
+        for (auto& worker : workers_)
+        {
+            worker->stop();
+        }
+        shards_.clear();
     }
 
 
     bool reliable_tcp_server_t::start()
     {
         std::weak_ptr<reliable_tcp_server_t> weak_this(shared_from_this());
-        return ibase::task::run_task_in_the_iocontext_sync<bool>(io_context_, [weak_this]() {
+        auto started = ibase::task::run_task_in_the_iocontext_sync<bool>(io_context_, [weak_this]() {
             auto shared_this = weak_this.lock();
             if (!shared_this)
             {
@@ -32,6 +76,15 @@ namespace ibase
 
             return shared_this->start_impl();
         });
+
+        auto shards_started = std::make_shared<std::atomic<bool>>(true);
+        run_on_shards([this, shards_started](shard_t& shard) {
+            if (!start_shard(shard))
+            {
+                *shards_started = false;
+            }
+        });
+        return started && *shards_started;
     }
 
     bool reliable_tcp_server_t::start_impl()
@@ -42,9 +95,34 @@ namespace ibase
         }
         started_ = true;
 
-        start_accept();
-        check_timer_id_ = timer_->start_timer(std::bind(&reliable_tcp_server_t::on_priodically_timer, this), 1, 1);
-        return check_timer_id_ != 0;
+        if (listen_per_shard())
+        {
+            return true;
+        }
+        return start_accept();
+    }
+
+    bool reliable_tcp_server_t::start_shard(shard_t& shard)
+    {
+        if (shard.check_timer_id_ == 0)
+        {
+            shard.check_timer_id_ = shard.timer_->start_timer([this, &shard]() {
+                on_priodically_timer(shard);
+            }, 1, 1);
+        }
+
+        if (!listen_per_shard() || (shard.acceptor_ && shard.acceptor_->is_open()))
+        {
+            return true;
+        }
+
+        shard.acceptor_ = std::make_unique<asio::ip::tcp::acceptor>(shard.io_context_);
+        if (!open_acceptor(*shard.acceptor_, true))
+        {
+            return false;
+        }
+        do_accept(shard);
+        return true;
     }
 
     void reliable_tcp_server_t::stop()
@@ -65,16 +143,37 @@ namespace ibase
 
             shared_this->stop_impl();
         });
+
+        run_on_shards([this](shard_t& shard) {
+            stop_shard(shard);
+        });
+        wait_for_handlers();
     }
 
     void reliable_tcp_server_t::stop_impl()
     {
-        timer_->stop_timer(check_timer_id_);
-        check_timer_id_ = 0;
-
         do_close();
-        sessions_.clear();
-        req_2_processor_.clear();
+    }
+
+    void reliable_tcp_server_t::stop_shard(shard_t& shard)
+    {
+        if (shard.acceptor_)
+        {
+            asio::error_code ec;
+            shard.acceptor_->close(ec);
+        }
+
+        shard.timer_->stop_timer(shard.check_timer_id_);
+        shard.check_timer_id_ = 0;
+
+        shard.sessions_.clear();
+        shard.session_count_ = 0;
+        shard.subscribers_.clear();
+        shard.unfiltered_sessions_.clear();
+        shard.idle_head_ = session_table_t::invalid_id;
+        shard.idle_tail_ = session_table_t::invalid_id;
+        shard.req_2_processor_.clear();
+        shard.default_handler_ = nullptr;
     }
 
     bool reliable_tcp_server_t::started()
@@ -82,111 +181,422 @@ namespace ibase
         return started_;
     }
 
+    void reliable_tcp_server_t::set_body_checksum(bool enable)
+    {
+        body_checksum_ = enable;
+    }
+
+    void reliable_tcp_server_t::set_compression(uint8_t codec_id, uint32_t min_body_length)
+    {
+        codec_ = codec::find_codec(codec_id);
+        compress_min_length_ = min_body_length;
+    }
+
+    void reliable_tcp_server_t::set_compact_header(bool enable)
+    {
+        compact_header_ = enable;
+    }
+
     void reliable_tcp_server_t::register_req_processor(uint32_t cmd, req_processor_t processor)
     {
+        register_req_processor_impl(cmd, req_handler_t{processor, nullptr, nullptr});
+    }
+
+    void reliable_tcp_server_t::register_req_view_processor(uint32_t cmd, req_view_processor_t processor)
+    {
+        register_req_processor_impl(cmd, req_handler_t{nullptr, processor, nullptr});
+    }
+
+    void reliable_tcp_server_t::register_stream_processor(uint32_t cmd, stream_processor_t processor)
+    {
+        register_req_processor_impl(cmd, req_handler_t{nullptr, nullptr, processor});
+    }
+
+    void reliable_tcp_server_t::register_req_processor_impl(uint32_t cmd, req_handler_t handler)
+    {
+        run_on_shards([cmd, handler](shard_t& shard) {
+            shard.req_2_processor_[cmd] = std::make_shared<const req_handler_t>(handler);
+        });
+    }
+
+    void reliable_tcp_server_t::unregister_req_processor(uint32_t cmd)
+    {
+        run_on_shards([cmd](shard_t& shard) {
+            shard.req_2_processor_.erase(cmd);
+        });
+    }
+
+    void reliable_tcp_server_t::set_default_req_view_processor(req_view_processor_t processor)
+    {
+        run_on_shards([processor](shard_t& shard) {
+            shard.default_handler_ = std::make_shared<const req_handler_t>(req_handler_t{nullptr, processor, nullptr});
+        });
+    }
+
+    bool reliable_tcp_server_t::send_rsp_for_req(uint32_t session_id, uint32_t cmd, uint32_t seq, uint8_t* rsp_buf, uint32_t rsp_len)
+    {
+        auto build_opt = make_build_opt();
+        return send_built_packets(session_id, packet_t::build_packets(cmd, seq, false, rsp_buf, rsp_len, &build_opt));
+    }
+
+    bool reliable_tcp_server_t::send_rsp_for_req(uint32_t session_id, uint32_t cmd, uint32_t seq, ibuffer&& rsp)
+    {
+        auto build_opt = make_build_opt();
+        return send_built_packets(session_id, packet_t::build_packets(cmd, seq, false, std::make_shared<ibuffer>(std::move(rsp)), &build_opt));
+    }
+
+    bool reliable_tcp_server_t::publish_notification(uint32_t cmd, uint8_t* notification_buf, uint32_t notification_len)
+    {
+        auto build_opt = make_build_opt();
+        return publish_built_packets(packet_t::build_packets(cmd, ++cur_seq_, true, notification_buf, notification_len, &build_opt));
+    }
+
+    bool reliable_tcp_server_t::publish_notification(uint32_t cmd, ibuffer&& notification)
+    {
+        auto build_opt = make_build_opt();
+        return publish_built_packets(packet_t::build_packets(cmd, ++cur_seq_, true, std::make_shared<ibuffer>(std::move(notification)), &build_opt));
+    }
+
+    bool reliable_tcp_server_t::send_rsp_for_req_async(uint32_t session_id, uint32_t cmd, uint32_t seq, uint8_t* rsp_buf, uint32_t rsp_len, send_callback_t callback)
+    {
+        auto build_opt = make_build_opt();
+        return send_built_packets_async(session_id, packet_t::build_packets(cmd, seq, false, rsp_buf, rsp_len, &build_opt), std::move(callback));
+    }
+
+    bool reliable_tcp_server_t::send_rsp_for_req_async(uint32_t session_id, uint32_t cmd, uint32_t seq, ibuffer&& rsp, send_callback_t callback)
+    {
+        auto build_opt = make_build_opt();
+        return send_built_packets_async(session_id, packet_t::build_packets(cmd, seq, false, std::make_shared<ibuffer>(std::move(rsp)), &build_opt), std::move(callback));
+    }
+
+    bool reliable_tcp_server_t::publish_notification_async(uint32_t cmd, uint8_t* notification_buf, uint32_t notification_len)
+    {
+        auto build_opt = make_build_opt();
+        return publish_built_packets_async(packet_t::build_packets(cmd, ++cur_seq_, true, notification_buf, notification_len, &build_opt));
+    }
+
+    bool reliable_tcp_server_t::publish_notification_async(uint32_t cmd, ibuffer&& notification)
+    {
+        auto build_opt = make_build_opt();
+        return publish_built_packets_async(packet_t::build_packets(cmd, ++cur_seq_, true, std::make_shared<ibuffer>(std::move(notification)), &build_opt));
+    }
+
+    reliable_tcp_server_t::send_callback_t reliable_tcp_server_t::report_to(std::shared_ptr<send_status_t> status)
+    {
+        return [status](bool sent) {
+            status->state = sent ? send_status_t::sent : send_status_t::failed;
+        };
+    }
+
+    bool reliable_tcp_server_t::send_built_packets(uint32_t session_id, std::vector<std::shared_ptr<packet_t>> packets)
+    {
+        if (packets.empty())
+        {
+            return false;
+        }
+
+        auto shard = get_shard(session_id);
+        if (shard == nullptr)
+        {
+            return false;
+        }
+
         std::weak_ptr<reliable_tcp_server_t> weak_this(shared_from_this());
-        ibase::task::run_task_in_the_iocontext_sync<void>(io_context_, [weak_this, cmd, processor]() {
+        return run_on_shard(*shard, [weak_this, shard, session_id, packets = std::move(packets)]() {
             auto shared_this = weak_this.lock();
             if (!shared_this)
             {
-                return;
+                return false;
             }
 
-            shared_this->register_req_processor_impl(cmd, processor);
+            return shared_this->send_packets(*shard, session_id, packets);
         });
     }
 
-    void reliable_tcp_server_t::register_req_processor_impl(uint32_t cmd, req_processor_t processor)
+    bool reliable_tcp_server_t::publish_built_packets(std::vector<std::shared_ptr<packet_t>> packets)
     {
-        req_2_processor_[cmd] = processor;
+        if (packets.empty())
+        {
+            return false;
+        }
+
+        //built and compressed once. every session of every shard queues and keeps for resending the very same
+        //packets, a publish costs each session a few reference counts and its share of the writes
+        shared_packets_t shared_packets = std::make_shared<const std::vector<std::shared_ptr<packet_t>>>(std::move(packets));
+        run_on_shards([this, shared_packets](shard_t& shard) {
+            publish_packets(shard, shared_packets);
+        });
+        return true;
     }
 
-    void reliable_tcp_server_t::unregister_req_processor(uint32_t cmd)
+    bool reliable_tcp_server_t::send_built_packets_async(uint32_t session_id, std::vector<std::shared_ptr<packet_t>> packets, send_callback_t callback)
     {
-        std::weak_ptr<reliable_tcp_server_t> weak_this(shared_from_this());
-        ibase::task::run_task_in_the_iocontext_sync<void>(io_context_, [weak_this, cmd]() {
-            auto shared_this = weak_this.lock();
-            if (!shared_this)
+        if (packets.empty())
+        {
+            return false;
+        }
+
+        //inbox tasks only run while the server is there, see post_to_shard
+        auto shard = get_shard(session_id);
+        if (shard == nullptr)
+        {
+            return false;
+        }
+
+        post_to_shard(*shard, [this, shard, session_id, packets = std::move(packets), callback = std::move(callback)]() {
+            auto sent = send_packets(*shard, session_id, packets);
+            if (callback)
             {
-                return;
+                callback(sent);
             }
-
-            shared_this->unregister_req_processor_impl(cmd);
         });
+        return true;
     }
 
-    void reliable_tcp_server_t::unregister_req_processor_impl(uint32_t cmd)
+    bool reliable_tcp_server_t::publish_built_packets_async(std::vector<std::shared_ptr<packet_t>> packets)
     {
-        req_2_processor_.erase(cmd);
+        if (packets.empty())
+        {
+            return false;
+        }
+
+        shared_packets_t shared_packets = std::make_shared<const std::vector<std::shared_ptr<packet_t>>>(std::move(packets));
+        for (auto& shard : shards_)
+        {
+            post_to_shard(*shard, [this, shard = shard.get(), shared_packets]() {
+                publish_packets(*shard, shared_packets);
+            });
+        }
+        return true;
     }
 
-    bool reliable_tcp_server_t::send_rsp_for_req(uint32_t session_id, uint32_t cmd, uint32_t seq, uint8_t* rsp_buf, uint32_t rsp_len)
+    bool reliable_tcp_server_t::send_packets(shard_t& shard, uint32_t session_id, const std::vector<std::shared_ptr<packet_t>>& packets)
     {
+        auto session = get_session(shard, session_id);
+        if (!session)
+        {
+            return false;
+        }
+
+        session->send_packets(packets);
+        return true;
+    }
+
+    void reliable_tcp_server_t::publish_packets(shard_t& shard, const shared_packets_t& packets)
+    {
+        auto publish_to = [&shard, &packets](const std::vector<uint32_t>& session_ids) {
+            for (auto session_id : session_ids)
+            {
+                auto info = shard.sessions_.find(session_id);
+                if ((info != nullptr) && info->session_)
+                {
+                    info->session_->send_packets(packets);
+                }
+            }
+        };
+
+        publish_to(shard.unfiltered_sessions_);
+        auto it = shard.subscribers_.find(packets->front()->cmd());
+        if (it != shard.subscribers_.end())
+        {
+            publish_to(it->second);
+        }
+    }
+
+    bool reliable_tcp_server_t::run_on_shard(shard_t& shard, small_task_t<bool> task)
+    {
+        if (shard.io_context_.get_executor().running_in_this_thread())
+        {
+            return task();
+        }
+
+        //one of our threads never waits for another, two shards waiting for each other would deadlock. a
+        //handler thread does not wait either, a slow shard would hold up the handlers of other sessions
+        if (running_in_a_shard() || running_in_handler_pool())
+        {
+            //queued as it is, the result is dropped
+            post_to_shard(shard, std::move(task));
+            return true;
+        }
+
+        return ibase::task::run_task_in_the_iocontext_sync<bool>(shard.io_context_, std::move(task));
+    }
+
+    void reliable_tcp_server_t::run_on_shards(std::function<void(shard_t& shard)> task)
+    {
+        std::weak_ptr<reliable_tcp_server_t> weak_this(shared_from_this());
+        for (auto& shard : shards_)
+        {
+            run_on_shard(*shard, [weak_this, task, shard = shard.get()]() {
+                auto shared_this = weak_this.lock();
+                if (!shared_this)
+                {
+                    return false;
+                }
+
+                task(*shard);
+                return true;
+            });
+        }
+    }
+
+    void reliable_tcp_server_t::post_to_shard(shard_t& shard, small_task_t<> task)
+    {
+        //counted before it is pushed, the drain never takes more than was counted
+        auto queued = shard.inbox_count_.fetch_add(1, std::memory_order_acq_rel);
+        shard.inbox_.push(std::move(task));
+        if (queued != 0)
+        {
+            return;
+        }
+
         std::weak_ptr<reliable_tcp_server_t> weak_this(shared_from_this());
-        return ibase::task::run_task_in_the_iocontext_sync<bool>(io_context_, [weak_this, session_id, cmd, seq, rsp_buf, rsp_len]() {
+        asio::post(shard.io_context_, [weak_this, &shard]() {
             auto shared_this = weak_this.lock();
             if (!shared_this)
             {
-                return false;
+                return;
             }
 
-            return shared_this->send_rsp_for_req_impl(session_id, cmd, seq, rsp_buf, rsp_len);
+            shared_this->drain_inbox(shard);
         });
     }
 
-    bool reliable_tcp_server_t::send_rsp_for_req_impl(uint32_t session_id, uint32_t cmd, uint32_t seq, uint8_t* rsp_buf, uint32_t rsp_len)
+    void reliable_tcp_server_t::drain_inbox(shard_t& shard)
     {
-        return send_packet(session_id, cmd, seq, false, rsp_buf, rsp_len);
-    }
+        uint32_t done = 0;
+        small_task_t<> task;
+        while ((done < max_inbox_batch) && shard.inbox_.pop(task))
+        {
+            task();
+            task = nullptr;
+            ++done;
+        }
+
+        //whatever was counted meanwhile, or is still being pushed, is taken by another round after the
+        //socket events that queued up
+        if (shard.inbox_count_.fetch_sub(done, std::memory_order_acq_rel) == done)
+        {
+            return;
+        }
 
-    bool reliable_tcp_server_t::publish_notification(uint32_t cmd, uint8_t* notification_buf, uint32_t notification_len)
-    {
         std::weak_ptr<reliable_tcp_server_t> weak_this(shared_from_this());
-        return ibase::task::run_task_in_the_iocontext_sync<bool>(io_context_, [weak_this, cmd, notification_buf, notification_len]() {
+        asio::post(shard.io_context_, [weak_this, &shard]() {
             auto shared_this = weak_this.lock();
             if (!shared_this)
             {
-                return false;
+                return;
             }
 
-            return shared_this->publish_notification_impl(cmd, notification_buf, notification_len);
+            shared_this->drain_inbox(shard);
         });
     }
 
-    bool reliable_tcp_server_t::publish_notification_impl(uint32_t cmd, uint8_t* notification_buf, uint32_t notification_len)
+    bool reliable_tcp_server_t::running_in_a_shard()
     {
-        auto seq = ++cur_seq_;
-        for (const auto& session : sessions_)
+        for (auto& shard : shards_)
         {
-            send_packet(session.second.session_->get_session_id(), cmd, seq, true, notification_buf, notification_len);
+            if (shard->io_context_.get_executor().running_in_this_thread())
+            {
+                return true;
+            }
         }
+        return false;
+    }
 
-        return true;
+    bool reliable_tcp_server_t::running_in_handler_pool()
+    {
+        return handler_pool_ && handler_pool_->get_io_context().get_executor().running_in_this_thread();
     }
 
-    bool reliable_tcp_server_t::send_packet(uint32_t session_id, uint32_t cmd, uint32_t seq, bool is_push, uint8_t* rsp_buf, uint32_t rsp_len)
+    reliable_tcp_server_t::shard_t& reliable_tcp_server_t::pick_shard()
     {
-        auto packet = packet_t::build_packet(cmd, seq, is_push, rsp_buf, rsp_len);
-        if (packet == nullptr)
+        if ((shards_.size() == 1) || (opt_.balance == balance_t::round_robin))
         {
-            return false;
+            return *shards_[next_shard_++ % shards_.size()];
         }
-        
-        auto session = get_session(session_id);
-        if (!session)
+
+        auto least = shards_.front().get();
+        for (auto& shard : shards_)
         {
-            return false;
+            if (shard->session_count_.load(std::memory_order_relaxed) < least->session_count_.load(std::memory_order_relaxed))
+            {
+                least = shard.get();
+            }
         }
+        return *least;
+    }
 
-        session->send_packet(packet);
+    reliable_tcp_server_t::shard_t* reliable_tcp_server_t::get_shard(uint32_t session_id)
+    {
+        //the shard index is in the low bits of the session id, see slot_table_t. with a worker count that is
+        //no power of 2 some tags have no shard, an id with one of those was never handed out
+        auto index = session_id & ((1u << shard_bits_) - 1);
+        if (index >= shards_.size())
+        {
+            return nullptr;
+        }
+        return shards_[index].get();
+    }
+
+    packet_t::build_opt_t reliable_tcp_server_t::make_build_opt()
+    {
+        return packet_t::build_opt_t{body_checksum_, codec_, compress_min_length_};
+    }
+
+    bool reliable_tcp_server_t::listen_per_shard()
+    {
+#if defined(SO_REUSEPORT)
+        return opt_.reuse_port;
+#else
+        return false;
+#endif
+    }
+
+    bool reliable_tcp_server_t::open_acceptor(asio::ip::tcp::acceptor& acceptor, bool reuse_port)
+    {
+        //reuse_address only counts when set before the bind
+        asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), port_);
+        asio::error_code ec;
+        acceptor.open(endpoint.protocol(), ec);
+        if (!ec)
+        {
+            acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true), ec);
+        }
+#if defined(SO_REUSEPORT)
+        if (!ec && reuse_port)
+        {
+            using reuse_port_t = asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+            acceptor.set_option(reuse_port_t(true), ec);
+        }
+#endif
+        if (!ec)
+        {
+            acceptor.bind(endpoint, ec);
+        }
+        if (!ec)
+        {
+            acceptor.listen(asio::socket_base::max_listen_connections, ec);
+        }
+
+        if (ec)
+        {
+            ibase::logger::write_log(ibase::logger::log_level_error, fmt::format("server listen on port {} failed, {}", port_, ec.message()));
+            asio::error_code ignored;
+            acceptor.close(ignored);
+            return false;
+        }
         return true;
     }
 
-    void reliable_tcp_server_t::start_accept()
+    bool reliable_tcp_server_t::start_accept()
     {
-        std::error_code ec;
-        acceptor_.set_option(asio::ip::tcp::acceptor::reuse_address(true), ec);
+        if (!acceptor_.is_open() && !open_acceptor(acceptor_, false))
+        {
+            return false;
+        }
         do_accept();
+        return true;
     }
 
     void reliable_tcp_server_t::do_close()
@@ -203,8 +613,10 @@ namespace ibase
 
     void reliable_tcp_server_t::do_accept()
     {
+        //the socket is opened right on the io_context of the shard that will own the session
+        auto& shard = pick_shard();
         std::weak_ptr<reliable_tcp_server_t> weak_this(shared_from_this());
-        acceptor_.async_accept([weak_this](std::error_code ec, asio::ip::tcp::socket socket)
+        acceptor_.async_accept(shard.io_context_, [weak_this, &shard](std::error_code ec, asio::ip::tcp::socket socket)
         {
             auto shared_this = weak_this.lock();
             if (!shared_this)
@@ -219,98 +631,436 @@ namespace ibase
             
             if (!ec)
             {
-                shared_this->add_new_session(std::move(socket));
+                if (shard.io_context_.get_executor().running_in_this_thread())
+                {
+                    shared_this->add_new_session(shard, std::move(socket));
+                }
+                else
+                {
+                    asio::post(shard.io_context_, [weak_this, &shard, socket = std::move(socket)]() mutable {
+                        auto shared_this = weak_this.lock();
+                        if (!shared_this)
+                        {
+                            return;
+                        }
+
+                        shared_this->add_new_session(shard, std::move(socket));
+                    });
+                }
             }
                 
             shared_this->do_accept();
         });
     }
 
-    void reliable_tcp_server_t::dispatch_packet(uint32_t session_id, std::shared_ptr<packet_t> packet)
+    void reliable_tcp_server_t::do_accept(shard_t& shard)
     {
-        on_heartbeat(session_id);
+        //the listener lives on the shard's io_context, so the session is added right in the handler
+        std::weak_ptr<reliable_tcp_server_t> weak_this(shared_from_this());
+        shard.acceptor_->async_accept([weak_this, &shard](std::error_code ec, asio::ip::tcp::socket socket)
+        {
+            auto shared_this = weak_this.lock();
+            if (!shared_this)
+            {
+                return;
+            }
 
-        if (packet->is_push())
+            if (!shard.acceptor_ || !shard.acceptor_->is_open())
+            {
+                return;
+            }
+
+            if (!ec)
+            {
+                shared_this->add_new_session(shard, std::move(socket));
+            }
+
+            shared_this->do_accept(shard);
+        });
+    }
+
+    void reliable_tcp_server_t::dispatch_packet(shard_t& shard, uint32_t session_id, const packet_view_t& packet)
+    {
+        on_heartbeat(shard, session_id);
+
+        if (packet.is_push())
         {
             return;
         }
 
-        auto it = req_2_processor_.find(packet->cmd());
-        if (it == req_2_processor_.end())
+        if (control_cmd::is_control_cmd(packet.cmd()))
+        {
+            dispatch_control_packet(shard, session_id, packet);
+            return;
+        }
+
+        auto it = shard.req_2_processor_.find(packet.cmd());
+        if ((it == shard.req_2_processor_.end()) && !shard.default_handler_)
         {
             return;
         }
         
-        auto callback = it->second;
+        auto handler = (it != shard.req_2_processor_.end()) ? it->second : shard.default_handler_;
 
-        //when we can use move capture of packet, make this async
-        callback(session_id, packet);
+        if (packet.is_fragment())
+        {
+            dispatch_fragment(shard, session_id, packet, handler);
+        }
+        else
+        {
+            dispatch_request(shard, session_id, packet, handler);
+        }
     }
 
+    void reliable_tcp_server_t::dispatch_control_packet(shard_t& shard, uint32_t session_id, const packet_view_t& packet)
+    {
+        auto info = shard.sessions_.find(session_id);
+        if (info == nullptr)
+        {
+            return;
+        }
+
+        if (packet.cmd() == control_cmd::hello_cmd)
+        {
+            auto capabilities = control_cmd::decode_capabilities(packet.body(), packet.body_length());
+            if (((capabilities & control_cmd::capability_subscriptions) != 0) && !info->filtered_)
+            {
+                info->filtered_ = true;
+                unfiltered_remove(shard, *info);
+            }
+            return;
+        }
+
+        //a client that did not ask for filtering keeps getting everything
+        if (!info->filtered_)
+        {
+            return;
+        }
 
-    void reliable_tcp_server_t::add_new_session(asio::ip::tcp::socket socket)
+        for (auto cmd : control_cmd::decode_cmds(packet.body(), packet.body_length()))
+        {
+            auto subscribed = info->subscriptions_.find(cmd);
+            if (packet.cmd() == control_cmd::subscribe_cmd)
+            {
+                if (subscribed == info->subscriptions_.end())
+                {
+                    subscriber_add(shard, session_id, *info, cmd);
+                }
+            }
+            else if ((packet.cmd() == control_cmd::unsubscribe_cmd) && (subscribed != info->subscriptions_.end()))
+            {
+                auto pos = subscribed->second;
+                info->subscriptions_.erase(subscribed);
+                subscriber_remove(shard, cmd, pos);
+            }
+        }
+    }
+
+    void reliable_tcp_server_t::dispatch_fragment(shard_t& shard, uint32_t session_id, const packet_view_t& packet, const handler_ptr_t& handler)
     {
-        auto id = ++cur_session_id;
-        auto timetamp = std::chrono::steady_clock::now();
+        if (handler->stream_processor_)
+        {
+            auto deliver = [session_id, handler](const packet_view_t& packet) {
+                stream_chunk_t chunk{packet.cmd(), packet.seq(), packet.fragment_offset(), packet.fragment_total_length(), packet.fragment_data(), packet.fragment_data_length()};
+                handler->stream_processor_(session_id, chunk);
+            };
+            if (!handler_pool_)
+            {
+                deliver(packet);
+                return;
+            }
+
+            post_to_handler_pool(shard, session_id, [deliver, packet = packet.retain()]() {
+                deliver(packet);
+            });
+            return;
+        }
+
+        auto session = get_session(shard, session_id);
+        if (!session)
+        {
+            return;
+        }
+
+        auto message = session->get_reassembler().on_fragment(packet);
+        if (!message)
+        {
+            return;
+        }
+
+        dispatch_request(shard, session_id, packet_view_t::from_packet(message), handler);
+    }
+
+    void reliable_tcp_server_t::dispatch_request(shard_t& shard, uint32_t session_id, const packet_view_t& packet, const handler_ptr_t& handler)
+    {
+        if (!handler_pool_)
+        {
+            invoke_handler(session_id, packet, *handler);
+            return;
+        }
+
+        //the view keeps the read chunk alive until the handler ran, the session reads on into a fresh one
+        post_to_handler_pool(shard, session_id, [session_id, packet = packet.retain(), handler]() {
+            invoke_handler(session_id, packet, *handler);
+        });
+    }
+
+    void reliable_tcp_server_t::post_to_handler_pool(shard_t& shard, uint32_t session_id, small_task_t<> task)
+    {
+        auto info = shard.sessions_.find(session_id);
+        if (info == nullptr)
+        {
+            return;
+        }
+
+        if (!info->strand_)
+        {
+            info->strand_.emplace(asio::make_strand(handler_pool_->get_io_context()));
+        }
+
+        pending_handlers_.fetch_add(1, std::memory_order_relaxed);
+        //the pool goes before the server does, what it still runs can use this
+        asio::post(*info->strand_, [this, task = std::move(task)]() {
+            task();
+
+            if (pending_handlers_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            {
+                return;
+            }
+
+            //a waiter checks the count under the lock, taking it here means it is either before its check or
+            //already waiting
+            std::lock_guard<std::mutex> lock(pending_handlers_mutex_);
+            handlers_done_.notify_all();
+        });
+    }
+
+    void reliable_tcp_server_t::wait_for_handlers()
+    {
+        //a handler stopping the server would wait for itself
+        if (!handler_pool_ || running_in_handler_pool())
+        {
+            return;
+        }
+
+        //the shards are stopped, nothing is added anymore. handlers queued before still run, their
+        //responses find no session
+        std::unique_lock<std::mutex> lock(pending_handlers_mutex_);
+        handlers_done_.wait(lock, [this]() {
+            return pending_handlers_.load(std::memory_order_acquire) == 0;
+        });
+    }
+
+    void reliable_tcp_server_t::invoke_handler(uint32_t session_id, const packet_view_t& packet, const req_handler_t& handler)
+    {
+        if (handler.view_processor_)
+        {
+            handler.view_processor_(session_id, packet);
+        }
+        else if (handler.processor_)
+        {
+            handler.processor_(session_id, packet.copy());
+        }
+        else if (handler.stream_processor_)
+        {
+            stream_chunk_t chunk{packet.cmd(), packet.seq(), 0, packet.body_length(), packet.body(), packet.body_length()};
+            handler.stream_processor_(session_id, chunk);
+        }
+    }
+
+
+    void reliable_tcp_server_t::add_new_session(shard_t& shard, asio::ip::tcp::socket socket)
+    {
+        //unique across shards, and get_shard finds the shard again from the id alone
+        session_info new_info;
+        new_info.last_recv_timepoint_ = std::chrono::steady_clock::now();
+        auto id = shard.sessions_.insert(std::move(new_info));
+        if (id == session_table_t::invalid_id)
+        {
+            ibase::logger::write_log(ibase::logger::log_level_warn, fmt::format("server shard {} is full, connection refused", shard.index_));
+            return;
+        }
 
         std::weak_ptr<reliable_tcp_server_t> weak_this(shared_from_this());
-        auto session = std::make_shared<reliable_tcp_session_t>(id, std::move(socket), io_context_, [weak_this](uint32_t session_id, std::shared_ptr<packet_t> packet) {
+        auto session = std::make_shared<reliable_tcp_session_t>(id, std::move(socket), shard.io_context_, [weak_this, &shard](uint32_t session_id, const packet_view_t& packet) {
             auto shared_this = weak_this.lock();
             if (!shared_this)
             {
                 return;
             }
-            shared_this->dispatch_packet(session_id, packet);
+            shared_this->dispatch_packet(shard, session_id, packet);
         });
 
         if (!session)
         {
+            shard.sessions_.erase(id);
             return;
         }
 
+        session->set_compact_header_allowed(compact_header_);
         session->start();
-        sessions_[id] = {session, timetamp};
+        auto info = shard.sessions_.find(id);
+        info->session_ = session;
+        idle_push_back(shard, id, *info);
+        shard.session_count_ = shard.sessions_.size();
+        info->unfiltered_pos_ = (uint32_t)shard.unfiltered_sessions_.size();
+        shard.unfiltered_sessions_.push_back(id);
     }
 
-    std::shared_ptr<reliable_tcp_session_t> reliable_tcp_server_t::get_session(uint32_t session_id)
+    std::shared_ptr<reliable_tcp_session_t> reliable_tcp_server_t::get_session(shard_t& shard, uint32_t session_id)
     {
-        auto it = sessions_.find(session_id);
-        if (it == sessions_.end())
+        auto info = shard.sessions_.find(session_id);
+        if (info == nullptr)
         {
             return nullptr;
         }
         
-        return it->second.session_;
+        return info->session_;
+    }
+
+    void reliable_tcp_server_t::remove_session(shard_t& shard, uint32_t session_id)
+    {
+        auto info = shard.sessions_.find(session_id);
+        if (info == nullptr)
+        {
+            return;
+        }
+
+        if (!info->filtered_)
+        {
+            unfiltered_remove(shard, *info);
+        }
+        for (auto& subscription : info->subscriptions_)
+        {
+            subscriber_remove(shard, subscription.first, subscription.second);
+        }
+        idle_unlink(shard, *info);
+        shard.sessions_.erase(session_id);
+    }
+
+    void reliable_tcp_server_t::unfiltered_remove(shard_t& shard, session_info& info)
+    {
+        auto& session_ids = shard.unfiltered_sessions_;
+        auto last = session_ids.back();
+        if (info.unfiltered_pos_ + 1 != session_ids.size())
+        {
+            session_ids[info.unfiltered_pos_] = last;
+            shard.sessions_.find(last)->unfiltered_pos_ = info.unfiltered_pos_;
+        }
+        session_ids.pop_back();
+    }
+
+    void reliable_tcp_server_t::subscriber_add(shard_t& shard, uint32_t session_id, session_info& info, uint32_t cmd)
+    {
+        auto& session_ids = shard.subscribers_[cmd];
+        info.subscriptions_[cmd] = (uint32_t)session_ids.size();
+        session_ids.push_back(session_id);
+    }
+
+    //the session at pos leaves the list of cmd. its own subscriptions_ entry is the caller's to drop, the
+    //entry of the last session, which takes its place, is updated here
+    void reliable_tcp_server_t::subscriber_remove(shard_t& shard, uint32_t cmd, uint32_t pos)
+    {
+        auto it = shard.subscribers_.find(cmd);
+        if (it == shard.subscribers_.end())
+        {
+            return;
+        }
+
+        auto& session_ids = it->second;
+        auto last = session_ids.back();
+        if (pos + 1 != session_ids.size())
+        {
+            session_ids[pos] = last;
+            shard.sessions_.find(last)->subscriptions_[cmd] = pos;
+        }
+        session_ids.pop_back();
+        if (session_ids.empty())
+        {
+            shard.subscribers_.erase(it);
+        }
+    }
+
+    void reliable_tcp_server_t::idle_push_back(shard_t& shard, uint32_t session_id, session_info& info)
+    {
+        info.idle_prev_ = shard.idle_tail_;
+        info.idle_next_ = session_table_t::invalid_id;
+        if (shard.idle_tail_ != session_table_t::invalid_id)
+        {
+            shard.sessions_.find(shard.idle_tail_)->idle_next_ = session_id;
+        }
+        else
+        {
+            shard.idle_head_ = session_id;
+        }
+        shard.idle_tail_ = session_id;
+    }
+
+    void reliable_tcp_server_t::idle_unlink(shard_t& shard, session_info& info)
+    {
+        if (info.idle_prev_ != session_table_t::invalid_id)
+        {
+            shard.sessions_.find(info.idle_prev_)->idle_next_ = info.idle_next_;
+        }
+        else
+        {
+            shard.idle_head_ = info.idle_next_;
+        }
+
+        if (info.idle_next_ != session_table_t::invalid_id)
+        {
+            shard.sessions_.find(info.idle_next_)->idle_prev_ = info.idle_prev_;
+        }
+        else
+        {
+            shard.idle_tail_ = info.idle_prev_;
+        }
+        info.idle_prev_ = session_table_t::invalid_id;
+        info.idle_next_ = session_table_t::invalid_id;
     }
 
-    void reliable_tcp_server_t::on_heartbeat(uint32_t session_id)
+    void reliable_tcp_server_t::on_heartbeat(shard_t& shard, uint32_t session_id)
     {
-        auto it = sessions_.find(session_id);
-        if (it == sessions_.end())
+        auto info = shard.sessions_.find(session_id);
+        if (info == nullptr)
         {
             return;
         }
         
-        it->second.last_recv_timepoint_ = std::chrono::steady_clock::now();
+        //coarse on purpose, a busy session moves to the back of the idle list once a second and not per packet.
+        //it may get expired that much late
+        auto now = std::chrono::steady_clock::now();
+        if (now - info->last_recv_timepoint_ < std::chrono::seconds(heartbeat_resolution_seconds))
+        {
+            return;
+        }
+        info->last_recv_timepoint_ = now;
+        if (shard.idle_tail_ != session_id)
+        {
+            idle_unlink(shard, *info);
+            idle_push_back(shard, session_id, *info);
+        }
     }
 
-    void reliable_tcp_server_t::on_priodically_timer()
+    void reliable_tcp_server_t::on_priodically_timer(shard_t& shard)
     {
         auto cur_timepoint = std::chrono::steady_clock::now();
         
-        for (auto it = sessions_.begin(); it != sessions_.end(); )
+        //only the sessions that expire are looked at, plus the first one that does not
+        while (shard.idle_head_ != session_table_t::invalid_id)
         {
-            auto time_passed_by_seconds = std::chrono::duration_cast<std::chrono::seconds>(cur_timepoint - it->second.last_recv_timepoint_);
+            auto session_id = shard.idle_head_;
+            auto time_passed_by_seconds = std::chrono::duration_cast<std::chrono::seconds>(cur_timepoint - shard.sessions_.find(session_id)->last_recv_timepoint_);
             if (time_passed_by_seconds.count() < max_heartbeat_interval_seconds)
             {
-                ++it;
-                continue;
+                break;
             }
             
-            ibase::logger::write_log(ibase::logger::log_level_debug, fmt::format("session not heartbeat, remove it =  {}", it->first));
+            ibase::logger::write_log(ibase::logger::log_level_debug, fmt::format("session not heartbeat, remove it =  {}", session_id));
             
-            it = sessions_.erase(it);
+            remove_session(shard, session_id);
         }
+        shard.session_count_ = shard.sessions_.size();
     }
 
 }
@@ -1,31 +1,158 @@
 #pragma once
+#include <atomic>
+#include <condition_variable>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
 #include <asio.hpp>
 #include "packet.hpp"
+#include "codec.hpp"
+#include "ibuffer.hpp"
 #include "itimer.hpp"
+#include "ithread.hpp"
+#include "ithread_pool.hpp"
+#include "typed_message.hpp"
+#include "slot_table.hpp"
+#include "mpsc_queue.hpp"
+#include "small_task.hpp"
 
 namespace ibase
 {
     class reliable_tcp_session_t;
 
-    //thread safe
+    //thread safe. with worker threads every session is pinned to one of them, calls for a session are
+    //routed to its thread
     class reliable_tcp_server_t : public std::enable_shared_from_this<reliable_tcp_server_t>
     {
+        using handler_strand_t = asio::strand<asio::io_context::executor_type>;
+
         struct session_info
         {
             std::shared_ptr<reliable_tcp_session_t> session_;
             std::chrono::steady_clock::time_point last_recv_timepoint_;
+            //the client announced control_cmd::capability_subscriptions, only subscriptions_ are pushed to it
+            bool filtered_{false};
+            //where the session is in the shard's lists, so it leaves them without a search: in
+            //unfiltered_sessions_ while not filtered_, and by cmd in subscribers_
+            uint32_t unfiltered_pos_{0};
+            std::unordered_map<uint32_t, uint32_t> subscriptions_;
+            //neighbours in the shard's idle list, 0 at its ends
+            uint32_t idle_prev_{0};
+            uint32_t idle_next_{0};
+            //with handler threads the session's requests are handled one after another through it, made
+            //with the first request
+            std::optional<handler_strand_t> strand_;
         };
         
-        using map_session_id_2_session_t = std::map<uint32_t, session_info>;
+        //the session id is the table id, tagged with the index of the shard
+        using session_table_t = slot_table_t<session_info>;
         constexpr static uint32_t max_heartbeat_interval_seconds = 20;
+        //last_recv_timepoint_ moves on at most this often, between two moves a packet costs no list update
+        constexpr static uint32_t heartbeat_resolution_seconds = 1;
+        //a shard runs at most this many queued tasks in a row before it lets its sockets in again
+        constexpr static uint32_t max_inbox_batch = 256;
         
     public:
         using req_processor_t = std::function<void(uint32_t session_id, std::shared_ptr<packet_t> packet)>;
-        using map_req_2_processor_t = std::map<uint32_t, req_processor_t>;
+        //zero-copy variant, the view points into the session read buffer and is only valid during the call
+        using req_view_processor_t = std::function<void(uint32_t session_id, const packet_view_t& packet)>;
+
+        //a piece of a request, delivered as soon as it arrives. offset + length == total_length marks the last one
+        struct stream_chunk_t
+        {
+            uint32_t cmd;
+            uint32_t seq;
+            uint32_t offset;
+            uint32_t total_length;
+            const uint8_t* data;
+            uint32_t length;
+        };
+        using stream_processor_t = std::function<void(uint32_t session_id, const stream_chunk_t& chunk)>;
+
+        struct req_handler_t
+        {
+            req_processor_t processor_;
+            req_view_processor_t view_processor_;
+            stream_processor_t stream_processor_;
+        };
+        //shared by everything queued for it, handing a request on copies no processor
+        using handler_ptr_t = std::shared_ptr<const req_handler_t>;
+        using map_req_2_processor_t = std::map<uint32_t, handler_ptr_t>;
+
+        //completion of an async send, whether the session was still there to take it
+        using send_callback_t = std::function<void(bool sent)>;
+        //the outcome of an async send for a caller that polls instead of taking a callback, see report_to()
+        struct send_status_t
+        {
+            enum state_t
+            {
+                pending,
+                sent,
+                failed,
+            };
+            std::atomic<int> state{pending};
+        };
+
+        //how accepted connections are spread over the worker threads
+        enum class balance_t
+        {
+            round_robin,
+            least_sessions,
+        };
+
+        struct server_opt_t
+        {
+            //sessions run on this many worker threads owned by the server, 0 keeps everything on the
+            //io_context passed in. accepting happens there unless reuse_port is set
+            uint32_t    worker_count{0};
+            balance_t   balance{balance_t::round_robin};
+            //every shard opens its own listening socket on the port with SO_REUSEPORT and the kernel spreads the
+            //connections over them, so accepting scales with the workers. balance is not used then. falls back
+            //to the one acceptor where the platform has no SO_REUSEPORT
+            bool        reuse_port{false};
+            //request processors run on this many threads of their own instead of the session's thread, so a
+            //slow one holds up no reads, acks or heartbeats. the requests of one session are still handled
+            //one after another in the order they came in, those of different sessions side by side.
+            //the packet views handed over stay valid during the call as usual, and once stop() returned no
+            //processor runs anymore. 0 runs them on the session's thread
+            uint32_t    handler_thread_count{0};
+        };
+    private:
+        //one thread's share of the sessions, everything in here but session_count_ is only touched on its io_context.
+        //every shard has its own copy of the processors so dispatch never leaves the thread
+        struct shard_t
+        {
+            shard_t(asio::io_context& io_context, uint32_t index, uint32_t index_bits);
+
+            asio::io_context&               io_context_;
+            uint32_t                        index_;
+            session_table_t                 sessions_;
+            std::atomic<uint32_t>           session_count_{0};
+            map_req_2_processor_t           req_2_processor_;
+            handler_ptr_t                   default_handler_;
+            //who a publish goes to. sessions whose client does not filter get every cmd. the order means
+            //nothing, a session leaving one swaps the last one into its place
+            std::map<uint32_t, std::vector<uint32_t>> subscribers_;
+            std::vector<uint32_t>           unfiltered_sessions_;
+            //sessions by last_recv_timepoint_, the longest silent first. the sweep stops at the first one
+            //that is not expired yet
+            uint32_t                        idle_head_{0};
+            uint32_t                        idle_tail_{0};
+            std::shared_ptr<itimer>         timer_;
+            uint32_t                        check_timer_id_{0};
+            //only with server_opt_t::reuse_port, accepts straight into this shard
+            std::unique_ptr<asio::ip::tcp::acceptor> acceptor_;
+            //tasks from other threads, run in batches on io_context_. inbox_count_ is what is queued and not run
+            //yet, the push that makes it 1 posts the drain
+            mpsc_queue_t<small_task_t<>>    inbox_;
+            std::atomic<uint32_t>           inbox_count_{0};
+        };
     public:
         reliable_tcp_server_t(asio::io_context& io_context, const uint16_t port);
+        reliable_tcp_server_t(asio::io_context& io_context, const uint16_t port, server_opt_t opt);
         ~reliable_tcp_server_t();
         reliable_tcp_server_t(const reliable_tcp_server_t& other) = delete;
         reliable_tcp_server_t(reliable_tcp_server_t&& other) = delete;
@@ -36,43 +163,146 @@ namespace ibase
         bool start();
         void stop();
         bool started();
+        //append a crc32c to every response and notification body, clients verify it and drop corrupted frames
+        void set_body_checksum(bool enable);
+        //compress every response and notification body of at least min_body_length bytes with a registered codec,
+        //codec::no_codec_id turns it off. the peer must have the codec registered as well
+        void set_compression(uint8_t codec_id, uint32_t min_body_length = packet_t::default_compress_min_length);
+        //let clients that ask for it switch their session to the compact header, on by default
+        void set_compact_header(bool enable);
         
         void register_req_processor(uint32_t cmd, req_processor_t processor);
+        void register_req_view_processor(uint32_t cmd, req_view_processor_t processor);
+        //requests larger than one packet are handed over chunk by chunk instead of after reassembly
+        void register_stream_processor(uint32_t cmd, stream_processor_t processor);
         void unregister_req_processor(uint32_t cmd);
+        //gets every request whose cmd has no processor registered, e.g. to hand it to a message_dispatcher_t
+        void set_default_req_view_processor(req_view_processor_t processor);
         
+        //the packets are built on the calling thread. called on one of the server's threads for a session of
+        //another one, handler threads included, the send is queued to that thread without waiting and reported as done
         bool send_rsp_for_req(uint32_t session_id, uint32_t cmd, uint32_t seq, uint8_t* rsp_buf, uint32_t rsp_len);
         bool publish_notification(uint32_t cmd, uint8_t* notification_buf, uint32_t notification_len);
+        //take the body over and write it to the sockets from there, without copying
+        bool send_rsp_for_req(uint32_t session_id, uint32_t cmd, uint32_t seq, ibuffer&& rsp);
+        bool publish_notification(uint32_t cmd, ibuffer&& notification);
+        //typed messages, see typed_message.hpp. encoded on the calling thread straight into the packets
+        template<typename message_t>
+        bool send_rsp_for_req(uint32_t session_id, uint32_t seq, const message_t& rsp);
+        template<typename message_t>
+        bool publish_notification(const message_t& notification);
+
+        //queue the send to the session's thread and return right away, from any thread. nothing waits and a
+        //burst of them is taken over by the session's thread in batches. the callback is optional and runs on
+        //that thread, keep it short. false only if there is nothing to send or no shard could have handed
+        //out session_id, the callback does not run then
+        bool send_rsp_for_req_async(uint32_t session_id, uint32_t cmd, uint32_t seq, uint8_t* rsp_buf, uint32_t rsp_len, send_callback_t callback = nullptr);
+        bool send_rsp_for_req_async(uint32_t session_id, uint32_t cmd, uint32_t seq, ibuffer&& rsp, send_callback_t callback = nullptr);
+        template<typename message_t>
+        bool send_rsp_for_req_async(uint32_t session_id, uint32_t seq, const message_t& rsp, send_callback_t callback = nullptr);
+        bool publish_notification_async(uint32_t cmd, uint8_t* notification_buf, uint32_t notification_len);
+        bool publish_notification_async(uint32_t cmd, ibuffer&& notification);
+        template<typename message_t>
+        bool publish_notification_async(const message_t& notification);
+        //a callback for the async sends that records the outcome in status
+        static send_callback_t report_to(std::shared_ptr<send_status_t> status);
     private:
         bool start_impl();
         void stop_impl();
-        void register_req_processor_impl(uint32_t cmd, req_processor_t processor);
-        void unregister_req_processor_impl(uint32_t cmd);
-        bool send_rsp_for_req_impl(uint32_t session_id, uint32_t cmd, uint32_t seq, uint8_t* rsp_buf, uint32_t rsp_len);
-        bool publish_notification_impl(uint32_t cmd, uint8_t* notification_buf, uint32_t notification_len);
+        bool start_shard(shard_t& shard);
+        void stop_shard(shard_t& shard);
+        void register_req_processor_impl(uint32_t cmd, req_handler_t handler);
+        bool send_built_packets(uint32_t session_id, std::vector<std::shared_ptr<packet_t>> packets);
+        bool publish_built_packets(std::vector<std::shared_ptr<packet_t>> packets);
+        bool send_built_packets_async(uint32_t session_id, std::vector<std::shared_ptr<packet_t>> packets, send_callback_t callback);
+        bool publish_built_packets_async(std::vector<std::shared_ptr<packet_t>> packets);
     private:
-        void add_new_session(asio::ip::tcp::socket socket);
-        std::shared_ptr<reliable_tcp_session_t> get_session(uint32_t session_id);
-        void on_heartbeat(uint32_t session_id);
-        void on_priodically_timer();
+        bool run_on_shard(shard_t& shard, small_task_t<bool> task);
+        void run_on_shards(std::function<void(shard_t& shard)> task);
+        void post_to_shard(shard_t& shard, small_task_t<> task);
+        void drain_inbox(shard_t& shard);
+        bool running_in_a_shard();
+        bool running_in_handler_pool();
+        shard_t& pick_shard();
+        //nullptr for an id no shard could have handed out
+        shard_t* get_shard(uint32_t session_id);
+        void add_new_session(shard_t& shard, asio::ip::tcp::socket socket);
+        std::shared_ptr<reliable_tcp_session_t> get_session(shard_t& shard, uint32_t session_id);
+        void remove_session(shard_t& shard, uint32_t session_id);
+        void idle_push_back(shard_t& shard, uint32_t session_id, session_info& info);
+        void idle_unlink(shard_t& shard, session_info& info);
+        void unfiltered_remove(shard_t& shard, session_info& info);
+        void subscriber_add(shard_t& shard, uint32_t session_id, session_info& info, uint32_t cmd);
+        void subscriber_remove(shard_t& shard, uint32_t cmd, uint32_t pos);
+        void on_heartbeat(shard_t& shard, uint32_t session_id);
+        void on_priodically_timer(shard_t& shard);
     private:
-        void start_accept();
+        bool listen_per_shard();
+        bool open_acceptor(asio::ip::tcp::acceptor& acceptor, bool reuse_port);
+        bool start_accept();
         void do_close();
         void do_accept();
-        void dispatch_packet(uint32_t session_id, std::shared_ptr<packet_t> packet);
-        bool send_packet(uint32_t session_id, uint32_t cmd, uint32_t seq, bool is_push, uint8_t* rsp_buf, uint32_t rsp_len);
+        void do_accept(shard_t& shard);
+        void dispatch_packet(shard_t& shard, uint32_t session_id, const packet_view_t& packet);
+        void dispatch_control_packet(shard_t& shard, uint32_t session_id, const packet_view_t& packet);
+        void dispatch_fragment(shard_t& shard, uint32_t session_id, const packet_view_t& packet, const handler_ptr_t& handler);
+        void dispatch_request(shard_t& shard, uint32_t session_id, const packet_view_t& packet, const handler_ptr_t& handler);
+        void post_to_handler_pool(shard_t& shard, uint32_t session_id, small_task_t<> task);
+        void wait_for_handlers();
+        static void invoke_handler(uint32_t session_id, const packet_view_t& packet, const req_handler_t& handler);
+        bool send_packets(shard_t& shard, uint32_t session_id, const std::vector<std::shared_ptr<packet_t>>& packets);
+        void publish_packets(shard_t& shard, const shared_packets_t& packets);
+        packet_t::build_opt_t make_build_opt();
     private:
         asio::io_context&                                           io_context_;
         asio::ip::tcp::acceptor                                     acceptor_;
         uint16_t                                                    port_{0};
-        map_req_2_processor_t                                       req_2_processor_;
+        server_opt_t                                                opt_;
         volatile std::atomic<bool>                                  started_ {false};
+        std::atomic<bool>                                           body_checksum_ {false};
+        std::atomic<const codec_t*>                                 codec_ {nullptr};
+        std::atomic<uint32_t>                                       compress_min_length_ {packet_t::default_compress_min_length};
+        std::atomic<bool>                                           compact_header_ {true};
 
-        map_session_id_2_session_t                                  sessions_;
-        std::atomic<uint32_t>                                       cur_session_id{0};
+        //declared before the shards, whose sessions hold sockets of the workers' io_contexts
+        std::vector<std::unique_ptr<ithread>>                       workers_;
+        std::unique_ptr<ithread_pool>                               handler_pool_;
+        //handlers posted to the pool and not finished yet, stop() waits for them. the mutex is only taken to
+        //wait and by the handler that brings the count to 0
+        std::atomic<uint32_t>                                       pending_handlers_{0};
+        std::mutex                                                  pending_handlers_mutex_;
+        std::condition_variable                                     handlers_done_;
+        std::vector<std::unique_ptr<shard_t>>                       shards_;
+        uint32_t                                                    shard_bits_{0};
+        std::atomic<uint32_t>                                       next_shard_{0};
         std::atomic<uint32_t>                                       cur_seq_{0};
-        
-        //timer
-        std::shared_ptr<itimer>                                     timer_;
-        uint32_t                                                    check_timer_id_{0};        
     };
+
+    template<typename message_t>
+    bool reliable_tcp_server_t::send_rsp_for_req(uint32_t session_id, uint32_t seq, const message_t& rsp)
+    {
+        auto build_opt = make_build_opt();
+        return send_built_packets(session_id, message::encode_packets(rsp, seq, false, &build_opt));
+    }
+
+    template<typename message_t>
+    bool reliable_tcp_server_t::publish_notification(const message_t& notification)
+    {
+        auto build_opt = make_build_opt();
+        return publish_built_packets(message::encode_packets(notification, ++cur_seq_, true, &build_opt));
+    }
+
+    template<typename message_t>
+    bool reliable_tcp_server_t::send_rsp_for_req_async(uint32_t session_id, uint32_t seq, const message_t& rsp, send_callback_t callback)
+    {
+        auto build_opt = make_build_opt();
+        return send_built_packets_async(session_id, message::encode_packets(rsp, seq, false, &build_opt), std::move(callback));
+    }
+
+    template<typename message_t>
+    bool reliable_tcp_server_t::publish_notification_async(const message_t& notification)
+    {
+        auto build_opt = make_build_opt();
+        return publish_built_packets_async(message::encode_packets(notification, ++cur_seq_, true, &build_opt));
+    }
 }
@@ -1,9 +1,11 @@
 #include "reliable_tcp_session.hpp"
 #include "reliable_tcp_server.hpp"
 #include <assert.h>
+#include <vector>
 #include <fmt/core.h>
 #include "ilogger.hpp"
 #include "task_runner.hpp"
+#include "control_cmd.hpp"
 
 namespace ibase
 {
@@ -13,7 +15,6 @@ namespace ibase
     , receive_packet_callback_(receive_packet_callback)
     , socket_(std::move(socket))
     , read_pending_(false)
-    , read_buf_(max_read_buffer_size)
     , timer_(std::make_shared<itimer>(io_context))
     {
     }
@@ -31,7 +32,7 @@ namespace ibase
     {
         if (packet->is_push())
         {
-            write_packets_.push_back({packet, 1, std::chrono::steady_clock::now()});
+            write_packets_.insert(packet->cmd(), packet->seq(), pending_packets_t::no_id, {packet, {}, 1}, resend_deadline());
             do_write_packet(packet);
         }
         else
@@ -40,11 +41,63 @@ namespace ibase
         }
     }
 
+    void reliable_tcp_session_t::send_packets(const std::vector<std::shared_ptr<packet_t>>& packets)
+    {
+        if (packets.empty())
+        {
+            return;
+        }
+
+        if (packets.size() == 1)
+        {
+            send_packet(packets.front());
+            return;
+        }
+
+        if (packets.front()->is_push())
+        {
+            send_packets(std::make_shared<const std::vector<std::shared_ptr<packet_t>>>(packets));
+            return;
+        }
+        do_write_packets(packets);
+    }
+
+    void reliable_tcp_session_t::send_packets(const shared_packets_t& packets)
+    {
+        if (!packets || packets->empty())
+        {
+            return;
+        }
+
+        if (packets->size() == 1)
+        {
+            send_packet(packets->front());
+            return;
+        }
+
+        if (packets->front()->is_push())
+        {
+            auto& packet = packets->front();
+            write_packets_.insert(packet->cmd(), packet->seq(), pending_packets_t::no_id, {packet, packets, 1}, resend_deadline());
+        }
+        do_write_packets(*packets);
+    }
+
     uint32_t reliable_tcp_session_t::get_session_id()
     {
         return session_id_;
     }
 
+    message_reassembler_t& reliable_tcp_session_t::get_reassembler()
+    {
+        return reassembler_;
+    }
+
+    void reliable_tcp_session_t::set_compact_header_allowed(bool allowed)
+    {
+        compact_header_allowed_ = allowed;
+    }
+
     void reliable_tcp_session_t::do_start()
     {
         check_timer_id_ = timer_->start_timer(std::bind(&reliable_tcp_session_t::on_priodically_timer, this), 1, 1);
@@ -58,9 +111,11 @@ namespace ibase
         timer_->stop_timer(check_timer_id_);
         check_timer_id_ = 0;
         
-        read_buf_.clear();
+        read_buf_.reset();
         write_packets_.clear();
+        send_queue_.clear();
         rencently_packet_tracker_.clear();
+        reassembler_.clear();
         
         read_pending_ = false;
         if (socket_.is_open())
@@ -84,18 +139,25 @@ namespace ibase
             return;
         }
                 
-        auto size_to_read = (read_buf_.free_size() > 0) ? read_buf_.free_size() : read_buf_.capacity();
+        //nothing buffered, wait for the peer without holding a buffer
+        if (!read_buf_)
+        {
+            do_wait_readable();
+            return;
+        }
+
+        auto size_to_read = (read_buf_->free_size() > 0) ? read_buf_->free_size() : read_buf_->capacity();
         if (size_to_read <= 0)
         {
             return;
         }
         
-        auto buf = read_buf_.prepare(size_to_read);
+        auto buf = read_buf_->prepare(size_to_read);
         read_pending_ = true;
         
         std::weak_ptr<reliable_tcp_session_t> weak_this(shared_from_this());
         socket_.async_read_some(asio::buffer(buf.data, buf.size),
-          [weak_this](std::error_code ec, std::size_t length)
+          [weak_this, read_buf = read_buf_, requested_size = (uint32_t)buf.size](std::error_code ec, std::size_t length) mutable
           {
             auto shared_this = weak_this.lock();
             if (!shared_this)
@@ -105,8 +167,13 @@ namespace ibase
 
             shared_this->read_pending_ = false;
 
-            if (!ec)
+            //a stopped session gave its buffer back while the read was in flight. the chunk was only held for
+            //the read, from here on recycle_read_buffer() counts the views handlers keep
+            auto current = (shared_this->read_buf_ == read_buf);
+            read_buf.reset();
+            if (!ec && current)
             {
+                shared_this->read_buffer_sizer_.on_read(requested_size, (uint32_t)length);
                 shared_this->process_read_data(length);
             }
             
@@ -114,6 +181,28 @@ namespace ibase
           });
     }
 
+    void reliable_tcp_session_t::do_wait_readable()
+    {
+        read_pending_ = true;
+
+        std::weak_ptr<reliable_tcp_session_t> weak_this(shared_from_this());
+        socket_.async_wait(asio::ip::tcp::socket::wait_read, [weak_this](std::error_code ec) {
+            auto shared_this = weak_this.lock();
+            if (!shared_this)
+            {
+                return;
+            }
+
+            shared_this->read_pending_ = false;
+
+            if (!ec)
+            {
+                shared_this->acquire_read_buffer();
+                shared_this->do_read_packet();
+            }
+        });
+    }
+
     void reliable_tcp_session_t::do_write_packet(const std::shared_ptr<packet_t> packet)
     {
         if (!is_connected())
@@ -121,19 +210,103 @@ namespace ibase
             return;
         }
         
+        send_queue_.push_back(packet);
+        do_send_queue();
+    }
+
+    void reliable_tcp_session_t::do_write_packets(const std::vector<std::shared_ptr<packet_t>>& packets)
+    {
+        if (!is_connected())
+        {
+            return;
+        }
+
+        send_queue_.insert(send_queue_.end(), packets.begin(), packets.end());
+        do_send_queue();
+    }
+
+    void reliable_tcp_session_t::do_send_queue()
+    {
+        //one write at a time, concurrent async_write calls could interleave their bytes on the socket
+        if (write_pending_ || send_queue_.empty())
+        {
+            return;
+        }
+        write_pending_ = true;
+
+        //everything queued while the last write was in flight goes out in one gather write, capped in bytes
+        //and pieces. header, body and trailer of a packet are separate pieces, a body may still be the
+        //caller's buffer. the batch stays alive in the handler until the write is done
+        std::vector<std::shared_ptr<packet_t>> batch;
+        std::vector<asio::const_buffer> buffers;
+        buffers.reserve(max_write_batch_buffers);
+        uint32_t batch_bytes = 0;
+        while (!send_queue_.empty())
+        {
+            packet_t::segment_t segments[packet_t::max_segments];
+            auto compact_header = compact_headers_ ? compact_headers_.get() + batch.size() * packet_t::max_compact_header_length : nullptr;
+            auto segment_count = send_queue_.front()->segments(segments, header_format_, compact_header);
+            uint32_t packet_bytes = 0;
+            for (uint32_t i = 0; i < segment_count; ++i)
+            {
+                packet_bytes += segments[i].length;
+            }
+
+            if (!batch.empty() && ((buffers.size() + segment_count > max_write_batch_buffers) || (batch_bytes + packet_bytes > max_write_batch_bytes)))
+            {
+                break;
+            }
+
+            for (uint32_t i = 0; i < segment_count; ++i)
+            {
+                buffers.push_back(asio::buffer(segments[i].data, segments[i].length));
+            }
+            batch_bytes += packet_bytes;
+            batch.push_back(std::move(send_queue_.front()));
+            send_queue_.pop_front();
+        }
+
         std::weak_ptr<reliable_tcp_session_t> weak_this(shared_from_this());
-        asio::async_write(socket_, asio::buffer(packet->data(), packet->length()),
-          [weak_this](std::error_code ec, std::size_t length)
+        asio::async_write(socket_, buffers,
+          [weak_this, batch = std::move(batch)](std::error_code ec, std::size_t)
           {
-            //we don't care. next packet sending is driven by timer
+            auto shared_this = weak_this.lock();
+            if (!shared_this)
+            {
+                return;
+            }
+
+            shared_this->write_pending_ = false;
+            if (ec)
+            {
+                //we don't care. resending is driven by timer
+                shared_this->send_queue_.clear();
+                return;
+            }
+
+            shared_this->do_send_queue();
           });
     }
 
+    void reliable_tcp_session_t::do_write_sending_packet(const sending_packet_info& packet_info)
+    {
+        if (!packet_info.fragments_)
+        {
+            do_write_packet(packet_info.packet_);
+        }
+        else
+        {
+            do_write_packets(*packet_info.fragments_);
+        }
+    }
+
     void reliable_tcp_session_t::process_read_data(uint32_t read_data_size)
     {
         if (read_data_size > 0)
         {
-            read_buf_.commit(read_data_size);
+            read_buf_->commit(read_data_size);
+            //one clock read for everything this read brought in
+            rencently_packet_tracker_.advance(std::chrono::steady_clock::now());
             process_packet();
         }
 
@@ -143,19 +316,43 @@ namespace ibase
     void reliable_tcp_session_t::process_packet() {
         do
         {
+            //a callback closed the connection and gave the buffer back
+            if (!read_buf_)
+            {
+                break;
+            }
+
             uint32_t consume_len = 0;
-            auto packet = packet_t::parse_packet(read_buf_.read_head(), read_buf_.size(), consume_len);
-            read_buf_.consume(consume_len);
+            packet_view_t packet;
+            auto parsed = packet_t::parse_packet_view(read_buf_->read_head(), read_buf_->size(), consume_len, packet);
+            read_buf_->consume(consume_len);
             
-            if (!packet)
+            if (!parsed)
             {
                 break;
             }
+            packet.set_chunk(&read_buf_);
+
+            if (packet.is_compressed())
+            {
+                packet = packet.decompress();
+                if (packet.data() == nullptr)
+                {
+                    ibase::logger::write_log(ibase::logger::log_level_warn, "server drop packet, can not decompress body");
+                    continue;
+                }
+            }
             
-            ibase::logger::write_log(ibase::logger::log_level_debug, fmt::format("server recv packet, cmd =  {}, seq = {}", packet->cmd(), packet->seq()));
+            ibase::logger::write_log(ibase::logger::log_level_debug, fmt::format("server recv packet, cmd =  {}, seq = {}", packet.cmd(), packet.seq()));
+
+            if (control_cmd::is_control_cmd(packet.cmd()))
+            {
+                process_control_packet(packet);
+                continue;
+            }
 
             //dispatch packet
-            if (packet->is_push())
+            if (packet.is_push())
             {
                 process_push_packet(packet);
             }
@@ -166,31 +363,118 @@ namespace ibase
             
             
         } while (1);
+
+        recycle_read_buffer();
+    }
+
+    void reliable_tcp_session_t::acquire_read_buffer()
+    {
+        read_buf_size_ = read_buffer_sizer_.size();
+        read_buf_ = read_buffer_pool_t::acquire(read_buf_size_);
+    }
+
+    void reliable_tcp_session_t::recycle_read_buffer()
+    {
+        if (!read_buf_)
+        {
+            return;
+        }
+
+        //everything parsed and the socket drained, hibernate until the peer sends again
+        if ((read_buf_->size() == 0) && read_buffer_sizer_.drained())
+        {
+            read_buf_.reset();
+            return;
+        }
+
+        //a handler kept views into this chunk alive or the traffic asks for another size, move the unread
+        //tail to a fresh chunk instead of overwriting them
+        if ((read_buf_.use_count() <= 1) && (read_buf_size_ == read_buffer_sizer_.size()))
+        {
+            return;
+        }
+
+        auto read_buf = std::move(read_buf_);
+        acquire_read_buffer();
+        auto unread_size = read_buf->size();
+        if (unread_size > 0)
+        {
+            auto slab = read_buf_->prepare(unread_size);
+            memcpy(slab.data, read_buf->read_head(), unread_size);
+            read_buf_->commit(unread_size);
+        }
     }
 
-    void reliable_tcp_session_t::process_request_packet(const std::shared_ptr<packet_t> packet)
+    void reliable_tcp_session_t::process_request_packet(const packet_view_t& packet)
     {
-        auto duplicate = rencently_packet_tracker_.on_receive_packet(packet->cmd(), packet->seq());
+        //later fragments follow whatever was decided for the first fragment of their message
+        if (packet.is_fragment() && (packet.fragment_offset() > 0))
+        {
+            if (!reassembler_.skipping(packet))
+            {
+                receive_packet_callback_(session_id_, packet);
+            }
+            return;
+        }
+
+        auto duplicate = rencently_packet_tracker_.on_receive_packet(packet.cmd(), packet.seq());
         if (duplicate)
         {
+            if (packet.is_fragment())
+            {
+                reassembler_.skip(packet);
+            }
             return;
         }
         
         receive_packet_callback_(session_id_, packet);
     }
 
-    void reliable_tcp_session_t::process_push_packet(const std::shared_ptr<packet_t> packet)
+    void reliable_tcp_session_t::process_push_packet(const packet_view_t& packet)
+    {
+        write_packets_.erase(pending_packets_t::make_key(packet.cmd(), packet.seq()));
+
+        receive_packet_callback_(session_id_, packet);
+    }
+
+    void reliable_tcp_session_t::process_control_packet(const packet_view_t& packet)
     {
-        for (auto it = write_packets_.begin(); it != write_packets_.end(); ++it)
+        if (packet.is_push())
         {
-            if ((it->packet_->cmd() == packet->cmd()) && (it->packet_->seq() == packet->seq()))
+            return;
+        }
+
+        if (packet.cmd() == control_cmd::hello_cmd)
+        {
+            process_hello(packet);
+        }
+
+        //the session looks after its connection only, subscriptions are kept by the server
+        receive_packet_callback_(session_id_, packet);
+    }
+
+    void reliable_tcp_session_t::process_hello(const packet_view_t& packet)
+    {
+        uint32_t capabilities = control_cmd::capability_subscriptions;
+        if (compact_header_allowed_)
+        {
+            capabilities |= control_cmd::capability_compact_header;
+        }
+        uint32_t peer_capabilities = control_cmd::decode_capabilities(packet.body(), packet.body_length());
+        if ((capabilities & peer_capabilities & control_cmd::capability_compact_header) != 0)
+        {
+            //the client parses both formats, so switching needs no sync with what is already queued
+            header_format_ = packet_t::header_format_t::compact;
+            if (!compact_headers_)
             {
-                write_packets_.erase(it);
-                break;
+                compact_headers_.reset(new uint8_t[max_write_batch_buffers * packet_t::max_compact_header_length]);
             }
+            ibase::logger::write_log(ibase::logger::log_level_debug, fmt::format("session {} uses compact header", session_id_));
         }
 
-        receive_packet_callback_(session_id_, packet);
+        uint8_t body[control_cmd::capabilities_length];
+        control_cmd::encode_capabilities(capabilities, body);
+        do_write_packet(packet_t::build_packet(control_cmd::hello_cmd, packet.seq(), false, body, sizeof(body)));
     }
 
     bool reliable_tcp_session_t::is_connected()
@@ -206,27 +490,30 @@ namespace ibase
 
     void reliable_tcp_session_t::do_resender_check(const std::chrono::steady_clock::time_point& cur_time_point)
     {
-        for (auto it = write_packets_.begin(); it != write_packets_.end(); )
+        std::vector<uint64_t> due_keys;
+        write_packets_.collect_due(cur_time_point, due_keys);
+        for (auto key : due_keys)
         {
-            auto time_passed_by_seconds = std::chrono::duration_cast<std::chrono::seconds>(cur_time_point - it->last_send_time_point_);
-
-            if (time_passed_by_seconds.count() < resend_interval_in_seconds)
+            auto packet_info = write_packets_.find(key);
+            if (packet_info == nullptr)
             {
-                ++it;
                 continue;
             }
 
-            if (it->cur_tries_ >= max_resend_tries)
+            if (packet_info->cur_tries_ >= max_resend_tries)
             {
-                it = write_packets_.erase(it);
+                write_packets_.erase(key);
                 continue;
             }
 
-            ++it->cur_tries_;
-            it->last_send_time_point_ = cur_time_point;
-            do_write_packet(it->packet_);
-
-            ++it;
+            ++packet_info->cur_tries_;
+            write_packets_.reschedule(key, cur_time_point + std::chrono::seconds(resend_interval_in_seconds));
+            do_write_sending_packet(*packet_info);
         }
     }
+
+    std::chrono::steady_clock::time_point reliable_tcp_session_t::resend_deadline()
+    {
+        return std::chrono::steady_clock::now() + std::chrono::seconds(resend_interval_in_seconds);
+    }
 }
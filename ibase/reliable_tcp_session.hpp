@@ -1,11 +1,14 @@
 #pragma once
 #include <asio.hpp>
-#include <list>
+#include <deque>
 #include <atomic>
 #include "packet.hpp"
 #include "io_buffer.hpp"
+#include "read_buffer_pool.hpp"
 #include "itimer.hpp"
 #include "recently_packet_tracker.hpp"
+#include "message_reassembler.hpp"
+#include "pending_packet_table.hpp"
 
 namespace ibase
 {
@@ -15,17 +18,21 @@ namespace ibase
         struct sending_packet_info
         {
             std::shared_ptr<packet_t> packet_;
+            shared_packets_t fragments_;   //all fragments when packet_ starts a fragmented message
             uint32_t cur_tries_{0};
-            std::chrono::steady_clock::time_point last_send_time_point_;
         };
         
-        using packet_list_t = std::list<sending_packet_info>;
-        constexpr static uint32_t max_read_buffer_size = 128*1024;
+        //pushes waiting for their ack by (cmd, seq), with the resend deadline
+        using pending_packets_t = pending_packet_table_t<sending_packet_info>;
+        using packet_queue_t = std::deque<std::shared_ptr<packet_t>>;
         constexpr static uint32_t max_resend_tries = 3;
         constexpr static uint32_t resend_interval_in_seconds = 3;
+        //one gather write takes at most this much of the send queue, asio hands at most 64 pieces to writev
+        constexpr static uint32_t max_write_batch_bytes = 256*1024;
+        constexpr static uint32_t max_write_batch_buffers = 64;
 
     public:
-        using receive_packet_callback_t = std::function<void(uint32_t session_id, std::shared_ptr<packet_t> packet)>;
+        using receive_packet_callback_t = std::function<void(uint32_t session_id, const packet_view_t& packet)>;
     public:
         reliable_tcp_session_t(uint32_t session_id, asio::ip::tcp::socket socket, asio::io_context& io_context, receive_packet_callback_t receive_packet_callback);
         ~reliable_tcp_session_t();
@@ -33,7 +40,14 @@ namespace ibase
         void start();
 
         void send_packet(std::shared_ptr<packet_t> packet);
+        //fragments of one message, written back to back without waiting for each other
+        void send_packets(const std::vector<std::shared_ptr<packet_t>>& packets);
+        //for a published message, the session keeps a reference for resending instead of a copy
+        void send_packets(const shared_packets_t& packets);
         uint32_t get_session_id();
+        message_reassembler_t& get_reassembler();
+        //whether the compact header may be used once the client asks for it, set before start()
+        void set_compact_header_allowed(bool allowed);
     private:
         reliable_tcp_session_t(const reliable_tcp_session_t& other) = delete;
         void operator=(const reliable_tcp_session_t& other) = delete;
@@ -44,26 +58,46 @@ namespace ibase
 
         void do_read_packet();
         void do_write_packet(const std::shared_ptr<packet_t> packet);
+        void do_write_packets(const std::vector<std::shared_ptr<packet_t>>& packets);
+        void do_write_sending_packet(const sending_packet_info& packet_info);
+        void do_send_queue();
         void process_read_data(uint32_t read_data_size);
         void process_packet();
-        void process_request_packet(const std::shared_ptr<packet_t> packet);
-        void process_push_packet(const std::shared_ptr<packet_t> packet);
+        void process_request_packet(const packet_view_t& packet);
+        void process_push_packet(const packet_view_t& packet);
+        void process_control_packet(const packet_view_t& packet);
+        void process_hello(const packet_view_t& packet);
+        void do_wait_readable();
+        void acquire_read_buffer();
+        void recycle_read_buffer();
         
         
         void on_priodically_timer();
         void do_resender_check(const std::chrono::steady_clock::time_point& cur_time_point);
+        std::chrono::steady_clock::time_point resend_deadline();
     private:
         asio::io_context&               io_context_;
         uint32_t                        session_id_;
         receive_packet_callback_t       receive_packet_callback_;
         asio::ip::tcp::socket           socket_;
         bool                            read_pending_;
-        bev::io_buffer                  read_buf_;
-        packet_list_t                   write_packets_;
+        //shared so a handler can retain() a packet view past the receive callback. borrowed from
+        //read_buffer_pool_t only while there is something to read, null while the session is idle
+        std::shared_ptr<bev::io_buffer> read_buf_;
+        uint32_t                        read_buf_size_{0};
+        read_buffer_sizer_t             read_buffer_sizer_;
+        pending_packets_t               write_packets_;
+        packet_queue_t                  send_queue_;
+        bool                            write_pending_{false};
+        bool                            compact_header_allowed_{true};
+        packet_t::header_format_t       header_format_{packet_t::header_format_t::classic};
+        //the compact headers of the batch being written, only made once the session switched to them
+        std::unique_ptr<uint8_t[]>      compact_headers_;
         
         //timer
         std::shared_ptr<itimer>         timer_;
         uint32_t                        check_timer_id_{0};
         recently_packet_tracker_t       rencently_packet_tracker_;
+        message_reassembler_t           reassembler_;
     };
 }
@@ -0,0 +1,173 @@
+#pragma once
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace ibase
+{
+    //values addressed by generational ids with O(1) insert, find and erase. an id is generation | slot | tag
+    //from the high bits to the low ones. a slot's generation moves on whenever it is freed, so an id that
+    //outlived its value finds nothing instead of whatever took the slot over. the tag is the same for every
+    //id of a table, the server puts the shard index there.
+    //the values themselves are kept dense in one array, iterating them never chases pointers
+    template<typename value_t>
+    class slot_table_t
+    {
+        struct slot_t
+        {
+            uint32_t generation_;
+            uint32_t index_;        //into entries_ while the slot is in use
+        };
+    public:
+        constexpr static uint32_t generation_bits = 12;
+        constexpr static uint32_t invalid_id = 0;
+
+        struct entry_t
+        {
+            uint32_t id_;
+            value_t value_;
+        };
+
+        //tag_bits of 20 at most, the slots get what generation and tag leave of the 32 bits
+        explicit slot_table_t(uint32_t tag_bits = 0, uint32_t tag = 0)
+            : tag_bits_(tag_bits)
+            , tag_(tag)
+            , slot_bits_(32 - generation_bits - tag_bits)
+        {
+        }
+
+        uint32_t capacity() const
+        {
+            return 1u << slot_bits_;
+        }
+
+        uint32_t size() const
+        {
+            return (uint32_t)entries_.size();
+        }
+
+        //invalid_id once capacity() values are in
+        uint32_t insert(value_t value)
+        {
+            uint32_t slot = 0;
+            if (!free_slots_.empty())
+            {
+                slot = free_slots_.back();
+                free_slots_.pop_back();
+            }
+            else if (slots_.size() < capacity())
+            {
+                slot = (uint32_t)slots_.size();
+                slots_.push_back(slot_t{1, 0});
+            }
+            else
+            {
+                return invalid_id;
+            }
+
+            slots_[slot].index_ = (uint32_t)entries_.size();
+            auto id = make_id(slots_[slot].generation_, slot);
+            entries_.push_back(entry_t{id, std::move(value)});
+            return id;
+        }
+
+        value_t* find(uint32_t id)
+        {
+            auto slot = find_slot(id);
+            if (slot == nullptr)
+            {
+                return nullptr;
+            }
+            return &entries_[slot->index_].value_;
+        }
+
+        //the last entry moves into the gap, erasing while walking entries by index means not advancing
+        bool erase(uint32_t id)
+        {
+            auto slot = find_slot(id);
+            if (slot == nullptr)
+            {
+                return false;
+            }
+
+            auto index = slot->index_;
+            if (index + 1 != entries_.size())
+            {
+                entries_[index] = std::move(entries_.back());
+                slots_[slot_of(entries_[index].id_)].index_ = index;
+            }
+            entries_.pop_back();
+            free_slot(id);
+            return true;
+        }
+
+        void clear()
+        {
+            //clearing is no excuse to hand out an id again
+            for (auto& entry : entries_)
+            {
+                free_slot(entry.id_);
+            }
+            entries_.clear();
+        }
+
+        entry_t& at(uint32_t index)
+        {
+            return entries_[index];
+        }
+
+        typename std::vector<entry_t>::iterator begin()
+        {
+            return entries_.begin();
+        }
+
+        typename std::vector<entry_t>::iterator end()
+        {
+            return entries_.end();
+        }
+    private:
+        uint32_t make_id(uint32_t generation, uint32_t slot) const
+        {
+            return (generation << (slot_bits_ + tag_bits_)) | (slot << tag_bits_) | tag_;
+        }
+
+        uint32_t slot_of(uint32_t id) const
+        {
+            return (id >> tag_bits_) & (capacity() - 1);
+        }
+
+        slot_t* find_slot(uint32_t id)
+        {
+            auto slot = slot_of(id);
+            if ((slot >= slots_.size()) || (make_id(slots_[slot].generation_, slot) != id))
+            {
+                return nullptr;
+            }
+            //once the generation wrapped around, a stale id can match a free slot
+            if ((slots_[slot].index_ >= entries_.size()) || (entries_[slots_[slot].index_].id_ != id))
+            {
+                return nullptr;
+            }
+            return &slots_[slot];
+        }
+
+        void free_slot(uint32_t id)
+        {
+            //generation 0 is skipped so that no id is ever invalid_id
+            auto& slot = slots_[slot_of(id)];
+            slot.generation_ = (slot.generation_ + 1) & ((1u << generation_bits) - 1);
+            if (slot.generation_ == 0)
+            {
+                slot.generation_ = 1;
+            }
+            free_slots_.push_back(slot_of(id));
+        }
+    private:
+        uint32_t                tag_bits_;
+        uint32_t                tag_;
+        uint32_t                slot_bits_;
+        std::vector<slot_t>     slots_;
+        std::vector<uint32_t>   free_slots_;
+        std::vector<entry_t>    entries_;
+    };
+}
@@ -0,0 +1,195 @@
+#pragma once
+#include <stddef.h>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace ibase
+{
+    template<typename result_t = void>
+    class small_task_t;
+
+    namespace detail
+    {
+        //what a task can do with the callable it holds. the table is the same for every result type, so a
+        //task that returns something moves into one that returns nothing as it is, no wrapper around it
+        struct task_ops_t
+        {
+            //result is a std::optional of the result type to emplace into, or nullptr to drop the result
+            void (*invoke)(void* storage, void* result);
+            //move constructs into the empty storage to and destroys from
+            void (*move)(void* from, void* to);
+            void (*destroy)(void* storage);
+        };
+
+        template<typename>
+        struct is_small_task : std::false_type {};
+
+        template<typename result_t>
+        struct is_small_task<small_task_t<result_t>> : std::true_type {};
+    }
+
+    //move-only callable for work that is posted to another thread or kept by a timer. a callable of up to
+    //inline_size bytes that moves without throwing lives in the task itself, so making, posting and running
+    //one allocates nothing; a bigger one is put on the heap. unlike std::function the callable is moved in,
+    //never copied, and may hold move-only state
+    template<typename result_t>
+    class small_task_t
+    {
+        template<typename>
+        friend class small_task_t;
+    public:
+        //room for a weak_ptr, a few ids and a vector or std::function next to each other
+        constexpr static size_t inline_size = 112;
+
+        small_task_t() = default;
+
+        small_task_t(std::nullptr_t)
+        {
+        }
+
+        template<typename callable_t, typename = std::enable_if_t<!detail::is_small_task<std::decay_t<callable_t>>::value && !std::is_same<std::decay_t<callable_t>, std::nullptr_t>::value>>
+        small_task_t(callable_t&& callable)
+        {
+            using stored_t = std::decay_t<callable_t>;
+            if constexpr (fits_inline<stored_t>())
+            {
+                new (storage_) stored_t(std::forward<callable_t>(callable));
+                ops_ = &inline_ops<stored_t>;
+            }
+            else
+            {
+                *reinterpret_cast<stored_t**>(storage_) = new stored_t(std::forward<callable_t>(callable));
+                ops_ = &heap_ops<stored_t>;
+            }
+        }
+
+        small_task_t(small_task_t&& other) noexcept
+        {
+            take(other);
+        }
+
+        //a task for nothing takes any other task and drops its result
+        template<typename other_result_t, typename = std::enable_if_t<std::is_void<result_t>::value && !std::is_void<other_result_t>::value>>
+        small_task_t(small_task_t<other_result_t>&& other) noexcept
+        {
+            take(other);
+        }
+
+        small_task_t& operator=(small_task_t&& other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                take(other);
+            }
+            return *this;
+        }
+
+        small_task_t& operator=(std::nullptr_t) noexcept
+        {
+            reset();
+            return *this;
+        }
+
+        ~small_task_t()
+        {
+            reset();
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return ops_ != nullptr;
+        }
+
+        //may run any number of times, the way an interval timer does
+        result_t operator()() const
+        {
+            auto storage = const_cast<unsigned char*>(storage_);
+            if constexpr (std::is_void<result_t>::value)
+            {
+                ops_->invoke(storage, nullptr);
+            }
+            else
+            {
+                std::optional<result_t> result;
+                ops_->invoke(storage, &result);
+                return std::move(*result);
+            }
+        }
+
+        void reset() noexcept
+        {
+            if (ops_ != nullptr)
+            {
+                ops_->destroy(storage_);
+                ops_ = nullptr;
+            }
+        }
+    private:
+        template<typename stored_t>
+        constexpr static bool fits_inline()
+        {
+            return (sizeof(stored_t) <= inline_size) && (alignof(stored_t) <= alignof(std::max_align_t)) && std::is_nothrow_move_constructible<stored_t>::value;
+        }
+
+        template<typename stored_t>
+        static void call(stored_t& callable, void* result)
+        {
+            if constexpr (!std::is_void<result_t>::value)
+            {
+                if (result != nullptr)
+                {
+                    static_cast<std::optional<result_t>*>(result)->emplace(callable());
+                    return;
+                }
+            }
+            callable();
+        }
+
+        template<typename stored_t>
+        constexpr static detail::task_ops_t inline_ops = {
+            [](void* storage, void* result) {
+                call(*static_cast<stored_t*>(storage), result);
+            },
+            [](void* from, void* to) {
+                auto callable = static_cast<stored_t*>(from);
+                new (to) stored_t(std::move(*callable));
+                callable->~stored_t();
+            },
+            [](void* storage) {
+                static_cast<stored_t*>(storage)->~stored_t();
+            }
+        };
+
+        template<typename stored_t>
+        constexpr static detail::task_ops_t heap_ops = {
+            [](void* storage, void* result) {
+                call(**static_cast<stored_t**>(storage), result);
+            },
+            [](void* from, void* to) {
+                *static_cast<stored_t**>(to) = *static_cast<stored_t**>(from);
+            },
+            [](void* storage) {
+                delete *static_cast<stored_t**>(storage);
+            }
+        };
+
+        template<typename other_result_t>
+        void take(small_task_t<other_result_t>& other) noexcept
+        {
+            if (other.ops_ == nullptr)
+            {
+                return;
+            }
+
+            other.ops_->move(other.storage_, storage_);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    private:
+        alignas(std::max_align_t) unsigned char     storage_[inline_size];
+        const detail::task_ops_t*                   ops_{nullptr};
+    };
+}
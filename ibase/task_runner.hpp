@@ -1,13 +1,15 @@
 #pragma once
 #include <asio.hpp>
 #include <future>
+#include "small_task.hpp"
 
 namespace ibase
 {
     namespace task
     {
+        //the caller waits, so the task stays where it is and the posted handler only refers to it
         template<typename R>
-        inline R run_task_in_the_iocontext_sync(asio::io_context& io_context, std::function<R()> task)
+        inline R run_task_in_the_iocontext_sync(asio::io_context& io_context, small_task_t<R> task)
         {
             if (io_context.get_executor().running_in_this_thread())
             {
@@ -17,16 +19,15 @@ namespace ibase
             std::promise<R> promise;
             auto future = promise.get_future();
             
-            io_context.post([task, &promise]() {
-                auto result = task();
-                promise.set_value(result);
+            asio::post(io_context, [&task, &promise]() {
+                promise.set_value(task());
             });
             
             return future.get();
         }
     
         template<>
-        inline void run_task_in_the_iocontext_sync<void>(asio::io_context& io_context, std::function<void()> task)
+        inline void run_task_in_the_iocontext_sync<void>(asio::io_context& io_context, small_task_t<void> task)
         {
             if (io_context.get_executor().running_in_this_thread())
             {
@@ -37,7 +38,7 @@ namespace ibase
             std::promise<void> promise;
             std::future<void> future = promise.get_future();
             
-            io_context.post([task, &promise]() {
+            asio::post(io_context, [&task, &promise]() {
                 task();
                 promise.set_value();
             });
@@ -45,7 +46,8 @@ namespace ibase
             future.get();
         }
 
-        inline void run_task_in_the_iocontext(asio::io_context& io_context, std::function<void()> task)
+        //the task is the handler, it is moved along and not wrapped again
+        inline void run_task_in_the_iocontext(asio::io_context& io_context, small_task_t<> task)
         {
             if (io_context.get_executor().running_in_this_thread())
             {
@@ -53,16 +55,12 @@ namespace ibase
                 return;
             }
 
-            io_context.post([task]() {
-                task();
-            });
+            asio::post(io_context, std::move(task));
         }
     
-        inline void run_task_in_the_iocontext_async(asio::io_context& io_context, std::function<void()> task)
+        inline void run_task_in_the_iocontext_async(asio::io_context& io_context, small_task_t<> task)
         {
-            io_context.post([task]() {
-                task();
-            });
+            asio::post(io_context, std::move(task));
         }
     }
 }
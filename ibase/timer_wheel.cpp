@@ -0,0 +1,347 @@
+#include "timer_wheel.hpp"
+#include <string.h>
+#include <algorithm>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace ibase
+{
+    namespace
+    {
+        inline uint32_t count_trailing_zeros64(uint64_t mask)
+        {
+#if defined(_MSC_VER)
+            unsigned long index = 0;
+            _BitScanForward64(&index, mask);
+            return index;
+#else
+            return __builtin_ctzll(mask);
+#endif
+        }
+
+        //first set bit at or after from in a bitmap of 64 bit words, -1 if there is none
+        inline int find_next_set(const uint64_t* bits, uint32_t words, uint32_t from)
+        {
+            for (uint32_t w = from / 64; w < words; ++w)
+            {
+                uint64_t word = bits[w];
+                if (w == from / 64)
+                {
+                    word &= ~0ull << (from % 64);
+                }
+                if (word != 0)
+                {
+                    return (int)(w * 64 + count_trailing_zeros64(word));
+                }
+            }
+            return -1;
+        }
+    }
+
+    asio::io_context::id timer_wheel_t::id;
+
+    timer_wheel_t::timer_wheel_t(asio::io_context& io_context)
+        : asio::io_context::service(io_context)
+        , timer_(io_context)
+        , start_(std::chrono::steady_clock::now())
+    {
+        for (auto& head : slots_)
+        {
+            head.prev_ = &head;
+            head.next_ = &head;
+        }
+        memset(occupied_, 0, sizeof(occupied_));
+    }
+
+    timer_wheel_t::~timer_wheel_t()
+    {
+    }
+
+    timer_wheel_t& timer_wheel_t::of(asio::io_context& io_context)
+    {
+        return asio::use_service<timer_wheel_t>(io_context);
+    }
+
+    uint32_t timer_wheel_t::next_timer_id()
+    {
+        auto timer_id = ++cur_timer_id_;
+        return (timer_id != 0) ? timer_id : ++cur_timer_id_;
+    }
+
+    void timer_wheel_t::schedule(uint32_t timer_id, small_task_t<> task, std::chrono::milliseconds delay, std::chrono::milliseconds interval)
+    {
+        auto node = allocate_node();
+        node->id_ = timer_id;
+        node->task_ = std::move(task);
+        node->interval_ticks_ = (interval.count() > 0) ? (uint64_t)interval.count() : 0;
+        //relative to the clock, the wheel itself only moves on when something is due. the tick under way counts
+        //as passed, so a timer never fires early
+        uint64_t delay_ticks = (delay.count() > 0) ? (uint64_t)delay.count() : 0;
+        node->expiry_tick_ = std::max(current_tick() + 1 + delay_ticks, now_tick_ + 1);
+        nodes_[timer_id] = node;
+        place(node);
+
+        //the node is looked at again when the current tick reaches its slot, which on an upper level is
+        //before it expires
+        uint32_t shift = slot_bits * (node->slot_ / slots_per_level);
+        uint64_t event_tick = (node->expiry_tick_ >> shift) << shift;
+        if (event_tick < armed_tick_)
+        {
+            arm(event_tick);
+        }
+    }
+
+    bool timer_wheel_t::cancel(uint32_t timer_id)
+    {
+        auto it = nodes_.find(timer_id);
+        if (it == nodes_.end())
+        {
+            return false;
+        }
+
+        auto node = it->second;
+        nodes_.erase(it);
+        if (node == firing_)
+        {
+            firing_cancelled_ = true;
+            return true;
+        }
+
+        unlink(node);
+        free_node(node);
+        return true;
+    }
+
+    uint32_t timer_wheel_t::size() const
+    {
+        return (uint32_t)nodes_.size();
+    }
+
+    void timer_wheel_t::shutdown()
+    {
+        //the tasks may hold objects that want the io_context, let them go while it is still there
+        for (auto& entry : nodes_)
+        {
+            entry.second->task_ = nullptr;
+        }
+        nodes_.clear();
+    }
+
+    uint64_t timer_wheel_t::current_tick() const
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+    void timer_wheel_t::place(node_t* node)
+    {
+        //the highest byte in which expiry and current tick differ picks the level. within it the slot is
+        //always ahead of the current one, so it is reached before the expiry
+        uint64_t diff = node->expiry_tick_ ^ now_tick_;
+        uint32_t level = 0;
+        while ((level + 1 < levels) && ((diff >> (slot_bits * (level + 1))) != 0))
+        {
+            ++level;
+        }
+
+        uint32_t index = (uint32_t)(node->expiry_tick_ >> (slot_bits * level)) & (slots_per_level - 1);
+        node->slot_ = level * slots_per_level + index;
+        auto& head = slots_[node->slot_];
+        node->prev_ = head.prev_;
+        node->next_ = &head;
+        head.prev_->next_ = node;
+        head.prev_ = node;
+        occupied_[level][index / 64] |= 1ull << (index % 64);
+    }
+
+    void timer_wheel_t::unlink(node_t* node)
+    {
+        node->prev_->next_ = node->next_;
+        node->next_->prev_ = node->prev_;
+        if (node->slot_ != no_slot)
+        {
+            auto& head = slots_[node->slot_];
+            if (head.next_ == &head)
+            {
+                uint32_t index = node->slot_ % slots_per_level;
+                occupied_[node->slot_ / slots_per_level][index / 64] &= ~(1ull << (index % 64));
+            }
+            node->slot_ = no_slot;
+        }
+    }
+
+    void timer_wheel_t::take_slot(uint32_t slot, link_t& out)
+    {
+        out.prev_ = &out;
+        out.next_ = &out;
+        auto& head = slots_[slot];
+        if (head.next_ == &head)
+        {
+            return;
+        }
+
+        out.next_ = head.next_;
+        out.prev_ = head.prev_;
+        out.next_->prev_ = &out;
+        out.prev_->next_ = &out;
+        head.prev_ = &head;
+        head.next_ = &head;
+        for (auto link = out.next_; link != &out; link = link->next_)
+        {
+            static_cast<node_t*>(link)->slot_ = no_slot;
+        }
+
+        uint32_t index = slot % slots_per_level;
+        occupied_[slot / slots_per_level][index / 64] &= ~(1ull << (index % 64));
+    }
+
+    uint64_t timer_wheel_t::next_event_tick() const
+    {
+        //whatever is due on a lower level comes before the next slot of any upper one is reached
+        for (uint32_t level = 0; level < levels; ++level)
+        {
+            uint32_t shift = slot_bits * level;
+            uint32_t cur = (uint32_t)(now_tick_ >> shift) & (slots_per_level - 1);
+            int index = find_next_set(occupied_[level], slots_per_level / 64, cur + 1);
+            if (index < 0)
+            {
+                continue;
+            }
+
+            uint64_t base = 0;
+            if (level + 1 < levels)
+            {
+                base = (now_tick_ >> (shift + slot_bits)) << (shift + slot_bits);
+            }
+            return base + ((uint64_t)index << shift);
+        }
+        return no_tick;
+    }
+
+    void timer_wheel_t::advance(uint64_t target_tick)
+    {
+        //jumps from one tick with something due to the next instead of walking every tick
+        while (now_tick_ < target_tick)
+        {
+            auto next_tick = next_event_tick();
+            if (next_tick > target_tick)
+            {
+                now_tick_ = target_tick;
+                return;
+            }
+
+            now_tick_ = next_tick;
+            process_tick();
+        }
+    }
+
+    void timer_wheel_t::process_tick()
+    {
+        uint32_t top = 0;
+        while ((top + 1 < levels) && ((now_tick_ & ((1ull << (slot_bits * (top + 1))) - 1)) == 0))
+        {
+            ++top;
+        }
+
+        //upper levels first, what moves down from there lands in lower slots still ahead or in the one due now
+        for (uint32_t level = top; level > 0; --level)
+        {
+            uint32_t index = (uint32_t)(now_tick_ >> (slot_bits * level)) & (slots_per_level - 1);
+            link_t moving;
+            take_slot(level * slots_per_level + index, moving);
+            while (moving.next_ != &moving)
+            {
+                auto node = static_cast<node_t*>(moving.next_);
+                unlink(node);
+                place(node);
+            }
+        }
+
+        link_t due;
+        take_slot((uint32_t)now_tick_ & (slots_per_level - 1), due);
+        fire(due);
+    }
+
+    void timer_wheel_t::fire(link_t& due)
+    {
+        //tasks may cancel nodes further down the list, so the next one is only looked up after each task
+        while (due.next_ != &due)
+        {
+            auto node = static_cast<node_t*>(due.next_);
+            unlink(node);
+
+            firing_ = node;
+            firing_cancelled_ = false;
+            node->task_();
+            firing_ = nullptr;
+
+            if (firing_cancelled_)
+            {
+                free_node(node);
+                continue;
+            }
+
+            if (node->interval_ticks_ == 0)
+            {
+                nodes_.erase(node->id_);
+                free_node(node);
+                continue;
+            }
+
+            //a late wheel does not fire an interval timer again for every interval it missed
+            node->expiry_tick_ = std::max(node->expiry_tick_ + node->interval_ticks_, now_tick_ + 1);
+            place(node);
+        }
+    }
+
+    void timer_wheel_t::arm(uint64_t tick)
+    {
+        armed_tick_ = tick;
+        timer_.expires_at(start_ + std::chrono::milliseconds(tick));
+        timer_.async_wait([this](const asio::error_code& ec) {
+            if (ec)
+            {
+                return;
+            }
+            on_expired();
+        });
+    }
+
+    void timer_wheel_t::on_expired()
+    {
+        armed_tick_ = no_tick;
+        advance(current_tick());
+
+        //tasks that started timers may have armed it already
+        auto next_tick = next_event_tick();
+        if (next_tick < armed_tick_)
+        {
+            arm(next_tick);
+        }
+    }
+
+    timer_wheel_t::node_t* timer_wheel_t::allocate_node()
+    {
+        if (free_nodes_ == nullptr)
+        {
+            chunks_.push_back(std::unique_ptr<node_t[]>(new node_t[nodes_per_chunk]));
+            auto chunk = chunks_.back().get();
+            for (uint32_t i = 0; i < nodes_per_chunk; ++i)
+            {
+                free_node(&chunk[i]);
+            }
+        }
+
+        auto node = free_nodes_;
+        free_nodes_ = static_cast<node_t*>(node->next_);
+        node->slot_ = no_slot;
+        return node;
+    }
+
+    void timer_wheel_t::free_node(node_t* node)
+    {
+        node->task_ = nullptr;
+        node->next_ = free_nodes_;
+        free_nodes_ = node;
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <asio.hpp>
+#include "small_task.hpp"
+
+namespace ibase
+{
+    //hierarchical timing wheel with millisecond ticks, one per io_context behind all of its itimers. timers sit
+    //in levels of 256 slots. a timer goes to the level of the highest byte in which its expiry tick differs
+    //from the current tick and moves down once the current tick reaches its slot, so insert and cancel are O(1)
+    //and a timer is touched at most once per level before it fires. a single steady_timer is armed for the
+    //next tick at which anything is due, nothing wakes up in between.
+    //everything but next_timer_id() has to be called on the io_context
+    class timer_wheel_t : public asio::io_context::service
+    {
+        struct link_t
+        {
+            link_t* prev_;
+            link_t* next_;
+        };
+
+        struct node_t : link_t
+        {
+            uint32_t                id_{0};
+            uint32_t                slot_{0};
+            uint64_t                expiry_tick_{0};
+            uint64_t                interval_ticks_{0};
+            small_task_t<>          task_;
+        };
+
+        constexpr static uint32_t slot_bits = 8;
+        constexpr static uint32_t slots_per_level = 1u << slot_bits;
+        constexpr static uint32_t levels = 64 / slot_bits;
+        constexpr static uint32_t no_slot = 0xffffffff;
+        constexpr static uint64_t no_tick = UINT64_MAX;
+        constexpr static uint32_t nodes_per_chunk = 1024;
+
+    public:
+        static asio::io_context::id id;
+
+        explicit timer_wheel_t(asio::io_context& io_context);
+        ~timer_wheel_t();
+
+        //the wheel of the io_context, created on first use and gone with the io_context
+        static timer_wheel_t& of(asio::io_context& io_context);
+
+        //thread safe, never 0
+        uint32_t next_timer_id();
+        //interval 0 fires once. the task may start and stop timers, its own included
+        void schedule(uint32_t timer_id, small_task_t<> task, std::chrono::milliseconds delay, std::chrono::milliseconds interval);
+        bool cancel(uint32_t timer_id);
+        uint32_t size() const;
+    private:
+        void shutdown() override;
+
+        uint64_t current_tick() const;
+        void place(node_t* node);
+        void unlink(node_t* node);
+        void take_slot(uint32_t slot, link_t& out);
+        uint64_t next_event_tick() const;
+        void advance(uint64_t target_tick);
+        void process_tick();
+        void fire(link_t& due);
+        void arm(uint64_t tick);
+        void on_expired();
+        node_t* allocate_node();
+        void free_node(node_t* node);
+    private:
+        timer_wheel_t(const timer_wheel_t& other) = delete;
+        timer_wheel_t& operator=(const timer_wheel_t& other) = delete;
+    private:
+        asio::steady_timer                          timer_;
+        std::chrono::steady_clock::time_point       start_;
+        uint64_t                                    now_tick_{0};
+        uint64_t                                    armed_tick_{no_tick};
+        std::atomic<uint32_t>                       cur_timer_id_{0};
+
+        link_t                                      slots_[levels * slots_per_level];
+        uint64_t                                    occupied_[levels][slots_per_level / 64];
+        std::unordered_map<uint32_t, node_t*>       nodes_;
+        //the node whose task runs right now, cancelling it only marks it
+        node_t*                                     firing_{nullptr};
+        bool                                        firing_cancelled_{false};
+
+        std::vector<std::unique_ptr<node_t[]>>      chunks_;
+        node_t*                                     free_nodes_{nullptr};
+    };
+}
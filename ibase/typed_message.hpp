@@ -0,0 +1,393 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <array>
+#include <functional>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "packet.hpp"
+#include "ibuffer.hpp"
+
+namespace ibase
+{
+    //a message type binds its cmd at compile time and (de)serializes itself:
+    //
+    //  struct login_req_t
+    //  {
+    //      constexpr static uint32_t cmd = 100;
+    //      uint32_t user_id{0};
+    //      std::string name;
+    //
+    //      uint32_t encoded_length() const { return sizeof(uint32_t) + message_writer_t::string_length(name); }
+    //      void encode(message_writer_t& writer) const { writer.write_u32(user_id); writer.write_string(name); }
+    //      bool decode(message_reader_t& reader) { return reader.read_u32(user_id) && reader.read_string(name); }
+    //  };
+    //
+    //integers go in network order, strings and byte arrays with a uint32 length in front. a response goes out
+    //with the cmd of its request, so a response type uses the cmd of the request type it answers
+
+    //writes into a body of exactly the announced length, normally the storage of the outgoing packet
+    class message_writer_t
+    {
+    public:
+        message_writer_t(uint8_t* buf, uint32_t len)
+            : buf_(buf)
+            , len_(len)
+        {
+        }
+
+        static uint32_t string_length(const std::string& s)
+        {
+            return sizeof(uint32_t) + (uint32_t)s.size();
+        }
+
+        void write_u8(uint8_t v)
+        {
+            write_raw(&v, sizeof(v));
+        }
+
+        void write_u16(uint16_t v)
+        {
+            uint8_t b[2] = {(uint8_t)(v >> 8), (uint8_t)v};
+            write_raw(b, sizeof(b));
+        }
+
+        void write_u32(uint32_t v)
+        {
+            uint8_t b[4] = {(uint8_t)(v >> 24), (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v};
+            write_raw(b, sizeof(b));
+        }
+
+        void write_u64(uint64_t v)
+        {
+            write_u32((uint32_t)(v >> 32));
+            write_u32((uint32_t)v);
+        }
+
+        void write_bytes(const void* data, uint32_t len)
+        {
+            write_u32(len);
+            write_raw(data, len);
+        }
+
+        void write_string(const std::string& s)
+        {
+            write_bytes(s.data(), (uint32_t)s.size());
+        }
+
+        void write_raw(const void* data, uint32_t len)
+        {
+            if (!ok_ || (len > len_ - pos_))
+            {
+                ok_ = false;
+                return;
+            }
+            if (len > 0)
+            {
+                memcpy(buf_ + pos_, data, len);
+            }
+            pos_ += len;
+        }
+
+        //every byte of the announced length written and nothing more attempted
+        bool complete() const
+        {
+            return ok_ && (pos_ == len_);
+        }
+    private:
+        uint8_t*    buf_;
+        uint32_t    len_;
+        uint32_t    pos_{0};
+        bool        ok_{true};
+    };
+
+    //bounds checked reads from a received body, every read returns false once the body runs out
+    class message_reader_t
+    {
+    public:
+        message_reader_t(const uint8_t* buf, uint32_t len)
+            : buf_(buf)
+            , len_(len)
+        {
+        }
+
+        bool read_u8(uint8_t& v)
+        {
+            return read_raw(&v, sizeof(v));
+        }
+
+        bool read_u16(uint16_t& v)
+        {
+            uint8_t b[2];
+            if (!read_raw(b, sizeof(b)))
+            {
+                return false;
+            }
+            v = (uint16_t)((b[0] << 8) | b[1]);
+            return true;
+        }
+
+        bool read_u32(uint32_t& v)
+        {
+            uint8_t b[4];
+            if (!read_raw(b, sizeof(b)))
+            {
+                return false;
+            }
+            v = ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+            return true;
+        }
+
+        bool read_u64(uint64_t& v)
+        {
+            uint32_t high = 0;
+            uint32_t low = 0;
+            if (!read_u32(high) || !read_u32(low))
+            {
+                return false;
+            }
+            v = ((uint64_t)high << 32) | low;
+            return true;
+        }
+
+        //points into the body instead of copying, valid as long as the packet is
+        bool read_bytes(const uint8_t*& data, uint32_t& len)
+        {
+            if (!read_u32(len) || (len > len_ - pos_))
+            {
+                ok_ = false;
+                return false;
+            }
+            data = buf_ + pos_;
+            pos_ += len;
+            return true;
+        }
+
+        bool read_string(std::string& s)
+        {
+            const uint8_t* data = nullptr;
+            uint32_t len = 0;
+            if (!read_bytes(data, len))
+            {
+                return false;
+            }
+            s.assign((const char*)data, len);
+            return true;
+        }
+
+        bool read_raw(void* data, uint32_t len)
+        {
+            if (!ok_ || (len > len_ - pos_))
+            {
+                ok_ = false;
+                return false;
+            }
+            if (len > 0)
+            {
+                memcpy(data, buf_ + pos_, len);
+            }
+            pos_ += len;
+            return true;
+        }
+
+        bool ok() const
+        {
+            return ok_;
+        }
+
+        uint32_t remaining() const
+        {
+            return len_ - pos_;
+        }
+    private:
+        const uint8_t*  buf_;
+        uint32_t        len_;
+        uint32_t        pos_{0};
+        bool            ok_{true};
+    };
+
+    namespace message
+    {
+        //encodes straight into the packet storage when the message fits into one uncompressed packet, a
+        //compressible one is encoded into an ibuffer the packet then points into. nullptr if the message needs
+        //more than one packet or encode() does not write exactly encoded_length() bytes
+        template<typename message_t>
+        std::shared_ptr<packet_t> encode_packet(const message_t& message, uint32_t seq, bool is_push, const packet_t::build_opt_t* opt = nullptr)
+        {
+            uint32_t body_len = message.encoded_length();
+            if (body_len > packet_t::max_body_length)
+            {
+                return nullptr;
+            }
+
+            auto packet = packet_t::prepare_packet(message_t::cmd, seq, is_push, body_len, opt);
+            if (packet)
+            {
+                message_writer_t writer(packet->body(), body_len);
+                message.encode(writer);
+                if (!writer.complete())
+                {
+                    return nullptr;
+                }
+                packet->seal_body();
+                return packet;
+            }
+
+            auto body = std::make_shared<ibuffer>(nullptr, body_len);
+            message_writer_t writer(body->buf(), body_len);
+            message.encode(writer);
+            if (!writer.complete())
+            {
+                return nullptr;
+            }
+            return packet_t::build_packet(message_t::cmd, seq, is_push, std::move(body), opt);
+        }
+
+        //one packet as encode_packet makes it, or the fragments of a larger message encoded once into an
+        //ibuffer they point into. empty if encode() does not write exactly encoded_length() bytes
+        template<typename message_t>
+        std::vector<std::shared_ptr<packet_t>> encode_packets(const message_t& message, uint32_t seq, bool is_push, const packet_t::build_opt_t* opt = nullptr)
+        {
+            std::vector<std::shared_ptr<packet_t>> packets;
+            uint32_t body_len = message.encoded_length();
+            if (body_len <= packet_t::max_body_length)
+            {
+                auto packet = encode_packet(message, seq, is_push, opt);
+                if (packet)
+                {
+                    packets.push_back(std::move(packet));
+                }
+                return packets;
+            }
+
+            auto body = std::make_shared<ibuffer>(nullptr, body_len);
+            message_writer_t writer(body->buf(), body_len);
+            message.encode(writer);
+            if (!writer.complete())
+            {
+                return packets;
+            }
+            return packet_t::build_packets(message_t::cmd, seq, is_push, std::move(body), opt);
+        }
+
+        //bytes after the last field decode() reads are ignored, so fields can be appended to a message later
+        template<typename message_t>
+        bool decode(const packet_view_t& packet, message_t& message)
+        {
+            if ((packet.cmd() != message_t::cmd) || ((packet.body() == nullptr) && (packet.body_length() > 0)))
+            {
+                return false;
+            }
+            message_reader_t reader(packet.body(), packet.body_length());
+            return message.decode(reader) && reader.ok();
+        }
+    }
+
+    //routes requests to typed handlers through a table sorted by cmd at compile time, hook it up with
+    //reliable_tcp_server_t::set_default_req_view_processor:
+    //
+    //  auto dispatcher = std::make_shared<message_dispatcher_t<login_req_t, logout_req_t>>();
+    //  dispatcher->on<login_req_t>([](uint32_t session_id, uint32_t seq, const login_req_t& req) { ... });
+    //  server->set_default_req_view_processor([dispatcher](uint32_t session_id, const packet_view_t& packet) {
+    //      dispatcher->dispatch(session_id, packet);
+    //  });
+    template<typename... message_ts>
+    class message_dispatcher_t
+    {
+        using invoker_t = bool (*)(const message_dispatcher_t& dispatcher, uint32_t session_id, const packet_view_t& packet);
+        struct entry_t
+        {
+            uint32_t    cmd;
+            invoker_t   invoker;
+        };
+        constexpr static uint32_t message_count = sizeof...(message_ts);
+        using table_t = std::array<entry_t, message_count>;
+
+    public:
+        template<typename message_t>
+        using handler_t = std::function<void(uint32_t session_id, uint32_t seq, const message_t& message)>;
+
+        template<typename message_t>
+        void on(handler_t<message_t> handler)
+        {
+            std::get<handler_t<message_t>>(handlers_) = std::move(handler);
+        }
+
+        //false if no message type owns the cmd, it has no handler or the body does not decode
+        bool dispatch(uint32_t session_id, const packet_view_t& packet) const
+        {
+            constexpr static table_t table = make_table();
+            static_assert(cmds_unique(table), "two message types of a dispatcher share a cmd");
+
+            uint32_t lo = 0;
+            uint32_t hi = message_count;
+            while (lo < hi)
+            {
+                uint32_t mid = (lo + hi) / 2;
+                if (table[mid].cmd < packet.cmd())
+                {
+                    lo = mid + 1;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+
+            if ((lo == message_count) || (table[lo].cmd != packet.cmd()))
+            {
+                return false;
+            }
+            return table[lo].invoker(*this, session_id, packet);
+        }
+    private:
+        template<typename message_t>
+        static bool invoke(const message_dispatcher_t& dispatcher, uint32_t session_id, const packet_view_t& packet)
+        {
+            auto& handler = std::get<handler_t<message_t>>(dispatcher.handlers_);
+            if (!handler)
+            {
+                return false;
+            }
+
+            message_t message;
+            if (!message::decode(packet, message))
+            {
+                return false;
+            }
+            handler(session_id, packet.seq(), message);
+            return true;
+        }
+
+        constexpr static table_t make_table()
+        {
+            table_t table{{entry_t{message_ts::cmd, &message_dispatcher_t::invoke<message_ts>}...}};
+            for (uint32_t i = 1; i < message_count; ++i)
+            {
+                for (uint32_t j = i; (j > 0) && (table[j].cmd < table[j - 1].cmd); --j)
+                {
+                    entry_t tmp = table[j];
+                    table[j] = table[j - 1];
+                    table[j - 1] = tmp;
+                }
+            }
+            return table;
+        }
+
+        constexpr static bool cmds_unique(const table_t& table)
+        {
+            for (uint32_t i = 1; i < message_count; ++i)
+            {
+                if (table[i].cmd == table[i - 1].cmd)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    private:
+        std::tuple<handler_t<message_ts>...> handlers_;
+    };
+}
@@ -0,0 +1,112 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <fmt/core.h>
+#include "ithread.hpp"
+#include "reliable_tcp_client.hpp"
+#include "reliable_tcp_server.hpp"
+
+//sends to session ids the server never issued or no longer has. with 3 workers the shard tag is 2 bits wide
+//and tag 3 belongs to no shard, none of these may reach a session and the server has to keep going
+
+namespace
+{
+    int failures = 0;
+
+    void expect(bool ok, const std::string& what)
+    {
+        if (!ok)
+        {
+            ++failures;
+            std::cout << "FAILED: " << what << std::endl;
+        }
+    }
+
+    template<typename predicate_t>
+    bool wait_for(predicate_t predicate, std::chrono::milliseconds timeout)
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!predicate())
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+            {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return true;
+    }
+
+    void expect_rejected(ibase::reliable_tcp_server_t& server, uint32_t session_id)
+    {
+        uint8_t rsp[] = {1, 2, 3};
+        expect(!server.send_rsp_for_req(session_id, 1, 1, rsp, sizeof(rsp)), fmt::format("send_rsp_for_req to {:#x} is rejected", session_id));
+
+        auto status = std::make_shared<ibase::reliable_tcp_server_t::send_status_t>();
+        if (server.send_rsp_for_req_async(session_id, 1, 1, rsp, sizeof(rsp), ibase::reliable_tcp_server_t::report_to(status)))
+        {
+            expect(wait_for([status]() { return status->state != ibase::reliable_tcp_server_t::send_status_t::pending; }, std::chrono::seconds(5)), fmt::format("async send to {:#x} is reported", session_id));
+            expect(status->state == ibase::reliable_tcp_server_t::send_status_t::failed, fmt::format("async send to {:#x} fails", session_id));
+        }
+        else
+        {
+            expect(status->state == ibase::reliable_tcp_server_t::send_status_t::pending, fmt::format("rejected async send to {:#x} runs no callback", session_id));
+        }
+    }
+}
+
+int main()
+{
+    const uint16_t port = 18210;
+    const uint32_t cmd = 1;
+
+    ibase::ithread accept_thread;
+    ibase::ithread client_thread;
+    ibase::reliable_tcp_server_t::server_opt_t opt;
+    opt.worker_count = 3;
+    auto server = std::make_shared<ibase::reliable_tcp_server_t>(accept_thread.get_io_context(), port, opt);
+    if (!server->start())
+    {
+        std::cout << "server start failed" << std::endl;
+        return 1;
+    }
+
+    std::atomic<uint32_t> issued_id{0};
+    server->register_req_view_processor(cmd, [&server, &issued_id](uint32_t session_id, const ibase::packet_view_t& packet) {
+        issued_id = session_id;
+        server->send_rsp_for_req(session_id, packet.cmd(), packet.seq(), nullptr, 0);
+    });
+
+    //tag 3, no shard
+    for (uint32_t session_id : {3u, 7u, 0x7ffu, 0xffffffffu})
+    {
+        expect_rejected(*server, session_id);
+    }
+    //a shard's tag, but never issued
+    for (uint32_t session_id : {1u, 2u, 0x1001u})
+    {
+        expect_rejected(*server, session_id);
+    }
+
+    //issued, then gone with its connection
+    auto client = std::make_shared<ibase::reliable_tcp_client_t>(client_thread.get_io_context());
+    client->start("127.0.0.1", port);
+    std::atomic<int> result{1};
+    uint8_t req[] = {4, 5, 6};
+    client->send_req_async(cmd, req, sizeof(req), nullptr, [&result](uint32_t, int send_result, std::shared_ptr<ibase::packet_t>) {
+        result = send_result;
+    });
+    expect(wait_for([&result]() { return result == 0; }, std::chrono::seconds(10)), "a request of a real session is answered");
+
+    //the server lets a silent session go once its heartbeat expired
+    auto session_id = issued_id.load();
+    client->stop();
+    expect(wait_for([&server, session_id]() { return !server->send_rsp_for_req(session_id, cmd, 1, nullptr, 0); }, std::chrono::seconds(30)), "a closed session is gone");
+    expect_rejected(*server, session_id);
+
+    server->stop();
+    std::cout << (failures == 0 ? "passed" : fmt::format("{} failed", failures)) << std::endl;
+    return (failures == 0) ? 0 : 1;
+}
@@ -24,4 +24,23 @@ target("exam")
     set_kind("binary")
     add_files("examples/*.cpp")
     add_deps("ibase")
-    add_packages("asio", "fmt", "spdlog")
\ No newline at end of file
+    add_packages("asio", "fmt", "spdlog")
+
+for _, file in ipairs(os.files("bench/*.cpp")) do
+    target(path.basename(file))
+        set_kind("binary")
+        set_default(false)
+        add_files(file)
+        add_deps("ibase")
+        add_packages("asio", "fmt")
+end
+
+for _, file in ipairs(os.files("tests/*.cpp")) do
+    target(path.basename(file))
+        set_kind("binary")
+        set_default(false)
+        set_group("tests")
+        add_files(file)
+        add_deps("ibase")
+        add_packages("asio", "fmt")
+end